@@ -0,0 +1,281 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "queue.h"
+#include "graph.h"
+#include "dijkstra.h"
+#include "path.h"
+#include "yen.h"
+
+// LRU cache of query results keyed on (source, sink). An entry keeps
+// everything Yen needs to go on: the paths found, every path generated so
+// far and the untrimmed candidates. A query for at most as many paths as
+// are known is answered from the entry; a query for more resumes the Yen
+// iterations where the last one stopped.
+//
+// The state of an entry is swapped with the arena, seen set and candidate
+// queue of the caller, so answering from an entry copies nothing, and the
+// caller's handles stay valid until its next query, when the state is
+// swapped back.
+
+typedef struct
+{
+  int source;
+  int sink;
+  int K;          // paths asked for so far
+  int found;      // less than K once no more paths exist
+  PathCostPair *paths;
+  int paths_capacity;
+  PathArena arena;
+  PathSet seen;
+  PriorityQueue pq;
+  int newer;      // LRU list, -1 at either end
+  int older;
+  int chain;      // next entry in the same bucket, -1 at the end
+} CachedQuery;
+
+typedef struct ResultCache
+{
+  CachedQuery *entries;
+  int capacity;
+  int size;
+  int newest;
+  int oldest;
+  int *buckets;
+  int num_buckets;
+  // the entry swapped into the caller's state, -1 for none
+  int checked_out;
+  PathArena *out_arena;
+  PathSet *out_seen;
+  PriorityQueue *out_pq;
+  long long hits;
+  long long extensions;
+  long long misses;
+} ResultCache;
+
+void init_result_cache(ResultCache *cache, int capacity)
+{
+  cache->capacity = capacity;
+  cache->size = 0;
+  cache->newest = -1;
+  cache->oldest = -1;
+  cache->checked_out = -1;
+  cache->hits = 0;
+  cache->extensions = 0;
+  cache->misses = 0;
+
+  cache->num_buckets = 1;
+  while (cache->num_buckets < 2 * capacity)
+    cache->num_buckets *= 2;
+  cache->buckets = (int *)malloc(cache->num_buckets * sizeof(int));
+  memset(cache->buckets, -1, cache->num_buckets * sizeof(int));
+
+  cache->entries = (CachedQuery *)malloc(capacity * sizeof(CachedQuery));
+  for (int i = 0; i < capacity; i++)
+  {
+    CachedQuery *entry = &cache->entries[i];
+    entry->paths_capacity = 16;
+    entry->paths = (PathCostPair *)malloc(entry->paths_capacity * sizeof(PathCostPair));
+    init_path_arena(&entry->arena);
+    init_path_set(&entry->seen);
+    initialize(&entry->pq);
+  }
+}
+
+// Frees the entries. Whatever state is checked out belongs to the caller
+// until then and is freed with it.
+void free_result_cache(ResultCache *cache)
+{
+  for (int i = 0; i < cache->capacity; i++)
+  {
+    CachedQuery *entry = &cache->entries[i];
+    free(entry->paths);
+    free_path_arena(&entry->arena);
+    free_path_set(&entry->seen);
+    free_queue(&entry->pq);
+  }
+  free(cache->entries);
+  free(cache->buckets);
+}
+
+int cache_bucket(ResultCache *cache, int source, int sink)
+{
+  unsigned int hash = ((unsigned int)source * 2654435761u) ^ ((unsigned int)sink * 40503u);
+  return hash & (cache->num_buckets - 1);
+}
+
+void swap_query_state(CachedQuery *entry, PathArena *arena, PathSet *seen, PriorityQueue *pq)
+{
+  PathArena temp_arena = entry->arena;
+  entry->arena = *arena;
+  *arena = temp_arena;
+
+  PathSet temp_seen = entry->seen;
+  entry->seen = *seen;
+  *seen = temp_seen;
+
+  PriorityQueue temp_pq = entry->pq;
+  entry->pq = *pq;
+  *pq = temp_pq;
+}
+
+// Gives the checked out state, if any, back to its entry.
+void return_cached_query(ResultCache *cache)
+{
+  if (cache->checked_out == -1)
+    return;
+  swap_query_state(&cache->entries[cache->checked_out], cache->out_arena, cache->out_seen, cache->out_pq);
+  cache->checked_out = -1;
+}
+
+void unlink_lru(ResultCache *cache, int index)
+{
+  CachedQuery *entry = &cache->entries[index];
+  if (entry->newer != -1)
+    cache->entries[entry->newer].older = entry->older;
+  else
+    cache->newest = entry->older;
+  if (entry->older != -1)
+    cache->entries[entry->older].newer = entry->newer;
+  else
+    cache->oldest = entry->newer;
+}
+
+void push_newest(ResultCache *cache, int index)
+{
+  CachedQuery *entry = &cache->entries[index];
+  entry->newer = -1;
+  entry->older = cache->newest;
+  if (cache->newest != -1)
+    cache->entries[cache->newest].newer = index;
+  cache->newest = index;
+  if (cache->oldest == -1)
+    cache->oldest = index;
+}
+
+// Returns the entry of (source, sink), made the most recently used one and
+// swapped into the caller's arena, seen set and queue, with room for K
+// paths. A new entry, taking the place of the least recently used one when
+// the cache is full, has K = found = 0. The caller computes what is missing
+// and updates K and found. Returns NULL, with nothing checked out, if there
+// is no memory for K paths.
+CachedQuery *check_out_query(ResultCache *cache, int source, int sink, int K, PathArena *arena, PathSet *seen,
+                             PriorityQueue *pq)
+{
+  return_cached_query(cache);
+
+  int bucket = cache_bucket(cache, source, sink);
+  int index = cache->buckets[bucket];
+  while (index != -1 && (cache->entries[index].source != source || cache->entries[index].sink != sink))
+    index = cache->entries[index].chain;
+
+  if (index != -1)
+  {
+    unlink_lru(cache, index);
+  }
+  else
+  {
+    if (cache->size < cache->capacity)
+    {
+      index = cache->size++;
+    }
+    else
+    {
+      // evict the least recently used entry
+      index = cache->oldest;
+      unlink_lru(cache, index);
+      int *link = &cache->buckets[cache_bucket(cache, cache->entries[index].source, cache->entries[index].sink)];
+      while (*link != index)
+        link = &cache->entries[*link].chain;
+      *link = cache->entries[index].chain;
+    }
+
+    CachedQuery *entry = &cache->entries[index];
+    entry->source = source;
+    entry->sink = sink;
+    entry->K = 0;
+    entry->found = 0;
+    entry->chain = cache->buckets[bucket];
+    cache->buckets[bucket] = index;
+  }
+  push_newest(cache, index);
+
+  CachedQuery *entry = &cache->entries[index];
+  if (K > entry->paths_capacity)
+  {
+    PathCostPair *paths = (PathCostPair *)realloc(entry->paths, K * sizeof(PathCostPair));
+    if (paths == NULL)
+      return NULL;
+    entry->paths = paths;
+    entry->paths_capacity = K;
+  }
+
+  swap_query_state(entry, arena, seen, pq);
+  cache->checked_out = index;
+  cache->out_arena = arena;
+  cache->out_seen = seen;
+  cache->out_pq = pq;
+  return entry;
+}
+
+// Whether the entry already holds the answer for K paths.
+int cached_query_complete(CachedQuery *entry, int K)
+{
+  return entry->found >= K || entry->found < entry->K;
+}
+
+// Counts a query that found entry in the state check_out_query() left it.
+void count_cached_query(ResultCache *cache, CachedQuery *entry, int K)
+{
+  if (entry->K == 0)
+    cache->misses++;
+  else if (cached_query_complete(entry, K))
+    cache->hits++;
+  else
+    cache->extensions++;
+}
+
+// Like yen_k_shortest_paths(), through the cache: K_paths receives the
+// first K paths of the entry of (source, sink), computing only the ones it
+// does not hold yet. Handles are into ws->arena until the next query.
+// Returns -1 if there is no memory for K paths.
+int cached_k_shortest_paths(ResultCache *cache, const Graph *graph, int source, int sink, int K, YenWorkspace *ws,
+                            PathCostPair K_paths[])
+{
+  CachedQuery *entry = check_out_query(cache, source, sink, K, &ws->arena, &ws->seen, &ws->pq);
+  if (entry == NULL)
+    return -1;
+  count_cached_query(cache, entry, K);
+
+  if (!cached_query_complete(entry, K))
+  {
+    if (entry->K == 0)
+    {
+      entry->found = first_shortest_path(graph, source, sink, ws, entry->paths);
+    }
+    else
+    {
+      // other queries may have moved the tree on since
+      ws->tree = sink_tree(&ws->trees, sink, graph);
+    }
+
+    if (entry->found > 0)
+      entry->found = extend_k_shortest_paths(graph, K, ws, entry->paths, entry->found, 1);
+    entry->K = K;
+  }
+
+  int found = entry->found < K ? entry->found : K;
+  memcpy(K_paths, entry->paths, found * sizeof(PathCostPair));
+  return found;
+}
+
+void print_cache_stats(FILE *out, ResultCache *cache)
+{
+  fprintf(out, "Cache: %lld hits, %lld extensions, %lld misses, %d entries\n", cache->hits, cache->extensions,
+          cache->misses, cache->size);
+}
+
+#endif
@@ -2,96 +2,192 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_ENTRIES 1000
-#define MAX_LENGTH 50
-
-typedef struct 
+// Turns a "Source,Target,Weight,..." CSV of named nodes into the edge list
+// read by load_graph(), giving every name an integer id in order of first
+// appearance, and writes the id -> name dictionary (the name of node i on
+// line i + 1, as graphConverter.c expects). The CSV is read once and both
+// outputs are streamed; names are interned through a hash table, so the
+// cost per field does not depend on how many names were seen.
+//
+//   ./dataProcessing [input.csv [mapped.txt [names.txt]]]
+
+// Width reserved for the counts line, rewritten once the counts are known.
+#define HEADER_WIDTH 64
+
+typedef struct
 {
-    char string[MAX_LENGTH];
-    int id;
-} map_entry;
-
-int AddString(map_entry *map, int *size, char *string) 
+    char **names;    // names[id]
+    int count;
+    int names_capacity;
+    int *slots;      // ids, -1 for empty slots
+    unsigned int *hashes;
+    int capacity;
+} NameTable;
+
+unsigned int HashString(const char *string)
 {
-    for (int i = 0; i < *size; i++) 
+    unsigned int hash = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *)string; *c != '\0'; c++)
     {
-        if (strcmp(map[i].string, string) == 0) 
-        {
-            return i; 
-        }
+        hash = (hash ^ *c) * 16777619u;
     }
+    return hash;
+}
 
-    if (*size >= MAX_ENTRIES) 
-    {
-        printf("Error: exceeded maximum entries.\n");
-        exit(EXIT_FAILURE);
-    }
-    strcpy(map[*size].string, string);
-    return (*size)++;
+void InitNameTable(NameTable *table)
+{
+    table->count = 0;
+    table->names_capacity = 1024;
+    table->names = (char **)malloc(table->names_capacity * sizeof(char *));
+    table->capacity = 2048;
+    table->slots = (int *)malloc(table->capacity * sizeof(int));
+    table->hashes = (unsigned int *)malloc(table->capacity * sizeof(unsigned int));
+    memset(table->slots, -1, table->capacity * sizeof(int));
 }
 
-int main() 
+void FreeNameTable(NameTable *table)
 {
-    FILE *file = fopen("doctorwho.csv", "r");
-    FILE *temp_file = fopen("temp-mapped-who.csv", "w"); 
-    if (file == NULL || final_file == NULL) 
+    for (int i = 0; i < table->count; i++)
     {
-        printf("Error opening file.\n");
-        return 1;
+        free(table->names[i]);
     }
+    free(table->names);
+    free(table->slots);
+    free(table->hashes);
+}
+
+void GrowNameTable(NameTable *table)
+{
+    int old_capacity = table->capacity;
+    int *old_slots = table->slots;
+    unsigned int *old_hashes = table->hashes;
 
-    char line[1024];
-    map_entry map[MAX_ENTRIES];
-    int mapSize = 0, edgeCount = 0;
-    fgets(line, sizeof(line), file);
+    table->capacity *= 2;
+    table->slots = (int *)malloc(table->capacity * sizeof(int));
+    table->hashes = (unsigned int *)malloc(table->capacity * sizeof(unsigned int));
+    memset(table->slots, -1, table->capacity * sizeof(int));
 
-    while (fgets(line, sizeof(line), file)) 
+    for (int i = 0; i < old_capacity; i++)
     {
-        char *source = strtok(line, ",");
-        char *target = strtok(NULL, ",");
-        AddString(map, &mapSize, source);
-        AddString(map, &mapSize, target);
+        if (old_slots[i] == -1)
+            continue;
+
+        int slot = old_hashes[i] & (table->capacity - 1);
+        while (table->slots[slot] != -1)
+            slot = (slot + 1) & (table->capacity - 1);
+        table->slots[slot] = old_slots[i];
+        table->hashes[slot] = old_hashes[i];
     }
 
-    rewind(file);
-    fgets(line, sizeof(line), file); 
+    free(old_slots);
+    free(old_hashes);
+}
+
+// Returns the id of string, giving it the next id (and writing it to
+// names_file) the first time it is seen.
+int AddString(NameTable *table, const char *string, FILE *names_file)
+{
+    unsigned int hash = HashString(string);
+    int slot = hash & (table->capacity - 1);
 
-    while (fgets(line, sizeof(line), file)) 
+    while (table->slots[slot] != -1)
     {
-        char *source = strtok(line, ",");
-        char *target = strtok(NULL, ",");
-        char *weightStr = strtok(NULL, ","); 
+        int id = table->slots[slot];
+        if (table->hashes[slot] == hash && strcmp(table->names[id], string) == 0)
+            return id;
+        slot = (slot + 1) & (table->capacity - 1);
+    }
 
-        int sourceId = AddString(map, &mapSize, source);
-        int targetId = AddString(map, &mapSize, target);
-        int weight = atoi(weightStr);
-        fprintf(temp_file, "%d %d %d\n", sourceId, targetId, weight);
-        edgeCount++;
+    if (table->count == table->names_capacity)
+    {
+        table->names_capacity *= 2;
+        table->names = (char **)realloc(table->names, table->names_capacity * sizeof(char *));
     }
 
-    fclose(file);
-    fclose(temp_file);
+    int id = table->count++;
+    table->names[id] = strdup(string);
+    table->slots[slot] = id;
+    table->hashes[slot] = hash;
+    fprintf(names_file, "%s\n", string);
+
+    if (2 * table->count > table->capacity)
+        GrowNameTable(table);
 
-    FILE *finalOutputFile = fopen("mapped-who.txt", "w"); 
-    if (final_file == NULL) 
+    return id;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *input_name = argc > 1 ? argv[1] : "doctorwho.csv";
+    const char *output_name = argc > 2 ? argv[2] : "mapped-who.txt";
+    const char *names_name = argc > 3 ? argv[3] : "mapped-who-names.txt";
+
+    FILE *file = fopen(input_name, "r");
+    FILE *final_file = fopen(output_name, "w");
+    FILE *names_file = fopen(names_name, "w");
+    if (file == NULL || final_file == NULL || names_file == NULL)
     {
-        printf("Error opening final output file.\n");
+        printf("Error opening file.\n");
         return 1;
     }
 
-    fprintf(temp_file, "Total Edges: %d, Total Unique Nodes: %d\n", edgeCount, mapSize);
+    // placeholder for the counts, which are only known at the end
+    fprintf(final_file, "%*s\n", HEADER_WIDTH, "");
     fprintf(final_file, "SourceID,TargetID,Weight\n");
 
-    temp_file = fopen("temp-mapped-who.csv", "r");
+    NameTable map;
+    InitNameTable(&map);
+
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+    long long edgeCount = 0, lineNumber = 1;
+
+    // skip the column names
+    getline(&line, &line_capacity, file);
 
-    while ((fgets(line, sizeof(line), temp_file)) != NULL) 
+    while ((length = getline(&line, &line_capacity, file)) != -1)
     {
-        fputs(line, final_file);
+        lineNumber++;
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+            line[--length] = '\0';
+        if (length == 0)
+            continue;
+
+        char *source = line;
+        char *target = strchr(source, ',');
+        char *weightStr = target != NULL ? strchr(target + 1, ',') : NULL;
+        if (weightStr == NULL)
+        {
+            printf("Skipping malformed line %lld.\n", lineNumber);
+            continue;
+        }
+        *target++ = '\0';
+        *weightStr++ = '\0';
+
+        int sourceId = AddString(&map, source, names_file);
+        int targetId = AddString(&map, target, names_file);
+        int weight = atoi(weightStr);
+        fprintf(final_file, "%d %d %d\n", sourceId, targetId, weight);
+        edgeCount++;
+    }
+    free(line);
+    fclose(file);
+
+    // fill in the counts, padded to the width of the placeholder
+    char header[HEADER_WIDTH + 1];
+    snprintf(header, sizeof(header), "Total Edges: %lld, Total Unique Nodes: %d", edgeCount, map.count);
+    rewind(final_file);
+    fprintf(final_file, "%-*s", HEADER_WIDTH, header);
+
+    if (fclose(final_file) != 0 || fclose(names_file) != 0)
+    {
+        printf("Error writing output files.\n");
+        FreeNameTable(&map);
+        return 1;
     }
 
-    fclose(temp_file);
-    fclose(final_file);
-    remove("temp-mapped-who.csv");
-    
+    printf("%lld edges, %d unique nodes.\n", edgeCount, map.count);
+    FreeNameTable(&map);
     return 0;
 }
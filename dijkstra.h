@@ -0,0 +1,925 @@
+#ifndef DIJKSTRA_H
+#define DIJKSTRA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "graph.h"
+#include "mask.h"
+
+// Distance of unreachable nodes, above the cost of every path: sums of costs
+// go through add_cost(), so a path costing INF or more counts as none.
+#define INF INT_MAX
+
+// Bucket queues need one bucket per possible edge weight, past this the
+// binary heap is used instead.
+#define MAX_BUCKET_WEIGHT 4096
+
+typedef enum
+{
+  DIJKSTRA_SCAN,   // O(V^2) linear scan for the minimum vertex
+  DIJKSTRA_HEAP,   // indexed binary heap with decrease-key
+  DIJKSTRA_BUCKET, // Dial's circular bucket queue for small integer weights
+  DIJKSTRA_BIDIR   // two heap searches, from the source and back from the sink
+} DijkstraEngine;
+
+DijkstraEngine dijkstra_engine = DIJKSTRA_HEAP;
+
+// Returns 0 and sets the engine if name is "scan", "heap", "bucket" or
+// "bidir".
+int set_dijkstra_engine(const char *name)
+{
+  if (strcmp(name, "scan") == 0)
+    dijkstra_engine = DIJKSTRA_SCAN;
+  else if (strcmp(name, "heap") == 0)
+    dijkstra_engine = DIJKSTRA_HEAP;
+  else if (strcmp(name, "bucket") == 0)
+    dijkstra_engine = DIJKSTRA_BUCKET;
+  else if (strcmp(name, "bidir") == 0)
+    dijkstra_engine = DIJKSTRA_BIDIR;
+  else
+    return -1;
+  return 0;
+}
+
+// a + b for costs a, b >= 0, or INF if either is INF or the sum reaches it.
+int add_cost(int a, int b)
+{
+  if (a == INF || b >= INF - a)
+    return INF;
+  return a + b;
+}
+
+// Writes the source -> sink node sequence to path and returns its length.
+int save_shortest_path(int source, int sink, int predecessors[], int path[])
+{
+  int index = 0;
+  for (int v = sink; v != source; v = predecessors[v])
+  {
+    path[index++] = v;
+  }
+  path[index] = source;
+  int length = index + 1;
+
+  // Reverse the path
+  int temp = 0, start = 0;
+  while (start < index) {
+    temp = path[start];
+    path[start] = path[index];
+    path[index] = temp;
+    start++;
+    index--;
+  }
+  return length;
+}
+
+// Binary min-heap of node ids ordered by distance[]. position[v] is the slot
+// of v in nodes[], or -1 when v is not queued, which makes decrease-key O(log V).
+typedef struct
+{
+  int *nodes;
+  int *position;
+  int size;
+} IndexedHeap;
+
+void heap_sift_up(IndexedHeap *heap, int i, int distance[])
+{
+  int v = heap->nodes[i];
+  while (i > 0)
+  {
+    int p = (i - 1) / 2;
+    if (distance[heap->nodes[p]] <= distance[v])
+      break;
+    heap->nodes[i] = heap->nodes[p];
+    heap->position[heap->nodes[i]] = i;
+    i = p;
+  }
+  heap->nodes[i] = v;
+  heap->position[v] = i;
+}
+
+void heap_sift_down(IndexedHeap *heap, int i, int distance[])
+{
+  int v = heap->nodes[i];
+  while (1)
+  {
+    int smallest = 2 * i + 1;
+    if (smallest >= heap->size)
+      break;
+    if (smallest + 1 < heap->size && distance[heap->nodes[smallest + 1]] < distance[heap->nodes[smallest]])
+      smallest++;
+    if (distance[heap->nodes[smallest]] >= distance[v])
+      break;
+    heap->nodes[i] = heap->nodes[smallest];
+    heap->position[heap->nodes[i]] = i;
+    i = smallest;
+  }
+  heap->nodes[i] = v;
+  heap->position[v] = i;
+}
+
+// Inserts v or, if already queued, restores order after its distance dropped.
+void heap_push_or_decrease(IndexedHeap *heap, int v, int distance[])
+{
+  if (heap->position[v] == -1)
+  {
+    heap->nodes[heap->size] = v;
+    heap->position[v] = heap->size;
+    heap->size++;
+  }
+  heap_sift_up(heap, heap->position[v], distance);
+}
+
+int heap_pop(IndexedHeap *heap, int distance[])
+{
+  int v = heap->nodes[0];
+  heap->position[v] = -1;
+  heap->size--;
+  if (heap->size > 0)
+  {
+    heap->nodes[0] = heap->nodes[heap->size];
+    heap->position[heap->nodes[0]] = 0;
+    heap_sift_down(heap, 0, distance);
+  }
+  return v;
+}
+
+// Search state of one thread, allocated once and kept across searches. A
+// node's entries only count if its stamp is the current generation, so a
+// new search starts by bumping the generation instead of clearing O(V)
+// arrays, and costs as much as the nodes it touches.
+typedef struct
+{
+  int *distance;
+  int *estimate;
+  int *predecessors;
+  char *classes;
+  IndexedHeap heap;
+  unsigned int *stamp;
+  unsigned int generation;
+  // the backward half of dijkstra_bidirectional(), allocated on first use
+  int *distance_back;
+  int *successors;
+  IndexedHeap backward;
+  // the buckets of dijkstra_bucket(), allocated on first use
+  int *bucket_head;
+  int *bucket_next;
+  int *bucket_prev;
+  int num_buckets;
+} SearchScratch;
+
+void init_search_scratch(SearchScratch *scratch, const Graph *graph)
+{
+  int n = graph->num_nodes;
+  scratch->distance = (int *)malloc(n * sizeof(int));
+  scratch->estimate = (int *)malloc(n * sizeof(int));
+  scratch->predecessors = (int *)malloc(n * sizeof(int));
+  scratch->classes = (char *)malloc(n * sizeof(char));
+  scratch->heap.nodes = (int *)malloc(n * sizeof(int));
+  scratch->heap.position = (int *)malloc(n * sizeof(int));
+  scratch->heap.size = 0;
+  scratch->stamp = (unsigned int *)calloc(n, sizeof(unsigned int));
+  scratch->generation = 0;
+  scratch->distance_back = NULL;
+  scratch->successors = NULL;
+  scratch->backward.nodes = NULL;
+  scratch->backward.position = NULL;
+  scratch->bucket_head = NULL;
+  scratch->bucket_next = NULL;
+  scratch->bucket_prev = NULL;
+  scratch->num_buckets = 0;
+}
+
+void free_search_scratch(SearchScratch *scratch)
+{
+  free(scratch->distance);
+  free(scratch->estimate);
+  free(scratch->predecessors);
+  free(scratch->classes);
+  free(scratch->heap.nodes);
+  free(scratch->heap.position);
+  free(scratch->stamp);
+  free(scratch->distance_back);
+  free(scratch->successors);
+  free(scratch->backward.nodes);
+  free(scratch->backward.position);
+  free(scratch->bucket_head);
+  free(scratch->bucket_next);
+  free(scratch->bucket_prev);
+}
+
+// Starts a search in which every node is unreached, unqueued and
+// unclassified.
+void begin_search(SearchScratch *scratch, int num_nodes)
+{
+  scratch->heap.size = 0;
+  scratch->generation++;
+  if (scratch->generation == 0)
+  {
+    // the stamps wrapped around: clear them once every 2^32 searches
+    memset(scratch->stamp, 0, num_nodes * sizeof(unsigned int));
+    scratch->generation = 1;
+  }
+}
+
+// Brings v into the current search, as unreached if it was not in it yet.
+void touch_node(SearchScratch *scratch, int v)
+{
+  if (scratch->stamp[v] == scratch->generation)
+    return;
+  scratch->stamp[v] = scratch->generation;
+  scratch->distance[v] = INF;
+  scratch->predecessors[v] = -1;
+  scratch->classes[v] = 0;
+  scratch->heap.position[v] = -1;
+  if (scratch->distance_back != NULL)
+  {
+    scratch->distance_back[v] = INF;
+    scratch->backward.position[v] = -1;
+  }
+}
+
+int get_min_vertex(int num_nodes, int distances[], char visited[])
+{
+  int min = INF, min_index = -1;
+
+  for (int vertex = 0; vertex < num_nodes; vertex++)
+  {
+    if (visited[vertex] == 0 && distances[vertex] <= min)
+    {
+      min = distances[vertex];
+      min_index = vertex;
+    }
+  }
+  return min_index;
+}
+
+// The engines below run in a SearchScratch started by dijkstra() and leave
+// the distances and predecessors of the nodes they reach in it.
+
+void dijkstra_scan(int source, int sink, const Graph *graph, const SearchMask *mask, SearchScratch *scratch)
+{
+  // the linear scan looks at every node each step, so all of them take part
+  for (int v = 0; v < graph->num_nodes; v++)
+  {
+    touch_node(scratch, v);
+  }
+  int *distance = scratch->distance;
+  int *predecessors = scratch->predecessors;
+  char *visited = scratch->classes;
+
+  distance[source] = 0;
+
+  for (int i = 0; i < graph->num_nodes; i++)
+  {
+    int curr_min_vertex = get_min_vertex(graph->num_nodes, distance, visited);
+    if (distance[curr_min_vertex] == INF) // everything left is unreachable
+      break;
+
+    visited[curr_min_vertex] = 1;
+    if (curr_min_vertex == sink)
+      break;
+
+    for (int e = graph->offsets[curr_min_vertex]; e < graph->offsets[curr_min_vertex + 1]; e++)
+    {
+      int adj_v = graph->targets[e];
+      int weight = graph->weights[e];
+
+      if (mask != NULL && (edge_banned(mask, e) || node_banned(mask, adj_v)))
+        continue;
+
+      int through = add_cost(distance[curr_min_vertex], weight);
+      if (visited[adj_v] != 1 && through < distance[adj_v])
+      {
+        distance[adj_v] = through;
+        predecessors[adj_v] = curr_min_vertex;
+      }
+    }
+  }
+}
+
+void dijkstra_heap(int source, int sink, const Graph *graph, const SearchMask *mask, SearchScratch *scratch)
+{
+  int *distance = scratch->distance;
+  int *predecessors = scratch->predecessors;
+  IndexedHeap *heap = &scratch->heap;
+
+  distance[source] = 0;
+  heap_push_or_decrease(heap, source, distance);
+
+  while (heap->size > 0)
+  {
+    int u = heap_pop(heap, distance);
+    if (u == sink)
+      break;
+
+    for (int e = graph->offsets[u]; e < graph->offsets[u + 1]; e++)
+    {
+      int adj_v = graph->targets[e];
+      int weight = graph->weights[e];
+
+      if (mask != NULL && (edge_banned(mask, e) || node_banned(mask, adj_v)))
+        continue;
+
+      touch_node(scratch, adj_v);
+      int through = add_cost(distance[u], weight);
+      if (through < distance[adj_v])
+      {
+        distance[adj_v] = through;
+        predecessors[adj_v] = u;
+        heap_push_or_decrease(heap, adj_v, distance);
+      }
+    }
+  }
+}
+
+// Dial's algorithm: with edge weights at most C, every queued distance lies in
+// [d, d + C] for the current minimum d, so C + 1 circular buckets suffice.
+// Buckets are intrusive doubly linked lists over next/prev so a node can be
+// moved when its distance decreases.
+void dijkstra_bucket(int source, int sink, const Graph *graph, const SearchMask *mask, int max_weight, SearchScratch *scratch)
+{
+  int num_buckets = max_weight + 1;
+  if (scratch->bucket_head == NULL || scratch->num_buckets < num_buckets)
+  {
+    free(scratch->bucket_head);
+    scratch->bucket_head = (int *)malloc(num_buckets * sizeof(int));
+    scratch->num_buckets = num_buckets;
+  }
+  if (scratch->bucket_next == NULL)
+  {
+    scratch->bucket_next = (int *)malloc(graph->num_nodes * sizeof(int));
+    scratch->bucket_prev = (int *)malloc(graph->num_nodes * sizeof(int));
+  }
+  int *head = scratch->bucket_head;
+  int *next = scratch->bucket_next;
+  int *prev = scratch->bucket_prev;
+  int *distance = scratch->distance;
+  int *predecessors = scratch->predecessors;
+  memset(head, -1, num_buckets * sizeof(int));
+
+  distance[source] = 0;
+  head[0] = source;
+  next[source] = -1;
+  prev[source] = -1;
+  int queued = 1;
+  int curr_distance = 0;
+
+  while (queued > 0)
+  {
+    int b = curr_distance % num_buckets;
+    if (head[b] == -1)
+    {
+      curr_distance++;
+      continue;
+    }
+
+    int u = head[b];
+    head[b] = next[u];
+    if (next[u] != -1)
+      prev[next[u]] = -1;
+    queued--;
+
+    if (u == sink)
+      break;
+
+    for (int e = graph->offsets[u]; e < graph->offsets[u + 1]; e++)
+    {
+      int adj_v = graph->targets[e];
+      int weight = graph->weights[e];
+
+      if (mask != NULL && (edge_banned(mask, e) || node_banned(mask, adj_v)))
+        continue;
+
+      touch_node(scratch, adj_v);
+      int through = add_cost(distance[u], weight);
+      if (through < distance[adj_v])
+      {
+        if (distance[adj_v] != INF) // unlink from its old bucket
+        {
+          if (prev[adj_v] != -1)
+            next[prev[adj_v]] = next[adj_v];
+          else
+            head[distance[adj_v] % num_buckets] = next[adj_v];
+          if (next[adj_v] != -1)
+            prev[next[adj_v]] = prev[adj_v];
+          queued--;
+        }
+
+        distance[adj_v] = through;
+        predecessors[adj_v] = u;
+
+        int nb = distance[adj_v] % num_buckets;
+        prev[adj_v] = -1;
+        next[adj_v] = head[nb];
+        if (head[nb] != -1)
+          prev[head[nb]] = adj_v;
+        head[nb] = adj_v;
+        queued++;
+      }
+    }
+  }
+}
+
+// Bidirectional Dijkstra: a forward heap search from the source and a
+// backward one from the sink over the reverse adjacency, always advancing
+// the side with the smaller minimum. best is the shortest source -> sink
+// path seen through an edge scanned by either side, and the searches stop
+// once the two minima add up to at least best, as no path through an
+// unsettled node can beat it. Bans apply to both sides: a backward step
+// along edge u -> v skips it when the edge or u is banned. On return
+// distance[sink] holds the cost and predecessors[] describes the path, as
+// for the other engines. sink_distance, the distances of the sink tree of a
+// guided search or NULL, lets the forward side skip the nodes that cannot
+// reach the sink at all.
+void dijkstra_bidirectional(int source, int sink, const Graph *graph, const SearchMask *mask, const int *sink_distance,
+                            SearchScratch *scratch)
+{
+  int num_nodes = graph->num_nodes;
+  if (scratch->distance_back == NULL)
+  {
+    scratch->distance_back = (int *)malloc(num_nodes * sizeof(int));
+    scratch->successors = (int *)malloc(num_nodes * sizeof(int));
+    scratch->backward.nodes = (int *)malloc(num_nodes * sizeof(int));
+    scratch->backward.position = (int *)malloc(num_nodes * sizeof(int));
+    // dijkstra() has only brought source and sink into the search so far,
+    // later nodes get their backward entries from touch_node()
+    scratch->distance_back[source] = INF;
+    scratch->distance_back[sink] = INF;
+    scratch->backward.position[source] = -1;
+    scratch->backward.position[sink] = -1;
+  }
+  int *distance = scratch->distance;
+  int *predecessors = scratch->predecessors;
+  int *distance_back = scratch->distance_back;
+  int *successors = scratch->successors;
+  IndexedHeap *forward = &scratch->heap;
+  IndexedHeap *backward = &scratch->backward;
+  backward->size = 0;
+
+  distance[source] = 0;
+  distance_back[sink] = 0;
+  heap_push_or_decrease(forward, source, distance);
+  heap_push_or_decrease(backward, sink, distance_back);
+
+  // the best path found so far uses edge meet_from -> meet_to
+  int best = source == sink ? 0 : INF;
+  int meet_from = -1, meet_to = -1;
+
+  while (forward->size > 0 && backward->size > 0)
+  {
+    int top_forward = distance[forward->nodes[0]];
+    int top_backward = distance_back[backward->nodes[0]];
+    if (add_cost(top_forward, top_backward) >= best)
+      break;
+
+    if (top_forward <= top_backward)
+    {
+      int u = heap_pop(forward, distance);
+      for (int e = graph->offsets[u]; e < graph->offsets[u + 1]; e++)
+      {
+        int adj_v = graph->targets[e];
+        int weight = graph->weights[e];
+
+        if (mask != NULL && (edge_banned(mask, e) || node_banned(mask, adj_v)))
+          continue;
+        if (sink_distance != NULL && sink_distance[adj_v] == INF)
+          continue;
+
+        touch_node(scratch, adj_v);
+        int through = add_cost(distance[u], weight);
+        if (through < distance[adj_v])
+        {
+          distance[adj_v] = through;
+          predecessors[adj_v] = u;
+          heap_push_or_decrease(forward, adj_v, distance);
+        }
+        int meeting = add_cost(through, distance_back[adj_v]);
+        if (meeting < best)
+        {
+          best = meeting;
+          meet_from = u;
+          meet_to = adj_v;
+        }
+      }
+    }
+    else
+    {
+      int v = heap_pop(backward, distance_back);
+      for (int r = graph->rev_offsets[v]; r < graph->rev_offsets[v + 1]; r++)
+      {
+        int adj_u = graph->rev_sources[r];
+        int e = graph->rev_edges[r];
+        int weight = graph->weights[e];
+
+        if (mask != NULL && (edge_banned(mask, e) || node_banned(mask, adj_u)))
+          continue;
+
+        touch_node(scratch, adj_u);
+        int through = add_cost(distance_back[v], weight);
+        if (through < distance_back[adj_u])
+        {
+          distance_back[adj_u] = through;
+          successors[adj_u] = v;
+          heap_push_or_decrease(backward, adj_u, distance_back);
+        }
+        int meeting = add_cost(distance[adj_u], through);
+        if (meeting < best)
+        {
+          best = meeting;
+          meet_from = adj_u;
+          meet_to = v;
+        }
+      }
+    }
+  }
+
+  // splice the backward half onto the forward predecessors
+  if (meet_from != -1)
+  {
+    predecessors[meet_to] = meet_from;
+    for (int v = meet_to; v != sink; v = successors[v])
+    {
+      predecessors[successors[v]] = v;
+    }
+    distance[sink] = best;
+  }
+}
+
+// Shortest path tree of all nodes towards one sink, from a backward search
+// over the reverse adjacency without bans. distance[v] is the exact cost of
+// v -> sink (INF if there is no path), successors[v] the next node on that
+// path and edges[v] the index of the edge v -> successors[v].
+typedef struct
+{
+  int sink;
+  int *distance;
+  int *successors;
+  int *edges;
+} SinkTree;
+
+void init_sink_tree(SinkTree *tree, const Graph *graph)
+{
+  tree->sink = -1;
+  tree->distance = (int *)malloc(graph->num_nodes * sizeof(int));
+  tree->successors = (int *)malloc(graph->num_nodes * sizeof(int));
+  tree->edges = (int *)malloc(graph->num_nodes * sizeof(int));
+}
+
+void free_sink_tree(SinkTree *tree)
+{
+  free(tree->distance);
+  free(tree->successors);
+  free(tree->edges);
+  tree->distance = NULL;
+  tree->successors = NULL;
+  tree->edges = NULL;
+}
+
+void clear_sink_tree(SinkTree *tree, int sink, const Graph *graph)
+{
+  for (int i = 0; i < graph->num_nodes; i++)
+  {
+    tree->distance[i] = INF;
+    tree->successors[i] = -1;
+    tree->edges[i] = -1;
+  }
+  tree->sink = sink;
+  tree->distance[sink] = 0;
+}
+
+void build_sink_tree_heap(SinkTree *tree, int sink, const Graph *graph)
+{
+  IndexedHeap heap;
+  heap.nodes = (int *)malloc(graph->num_nodes * sizeof(int));
+  heap.position = (int *)malloc(graph->num_nodes * sizeof(int));
+  heap.size = 0;
+  memset(heap.position, -1, graph->num_nodes * sizeof(int));
+
+  clear_sink_tree(tree, sink, graph);
+  heap_push_or_decrease(&heap, sink, tree->distance);
+
+  while (heap.size > 0)
+  {
+    int v = heap_pop(&heap, tree->distance);
+    for (int r = graph->rev_offsets[v]; r < graph->rev_offsets[v + 1]; r++)
+    {
+      int adj_u = graph->rev_sources[r];
+      int e = graph->rev_edges[r];
+
+      int through = add_cost(tree->distance[v], graph->weights[e]);
+      if (through < tree->distance[adj_u])
+      {
+        tree->distance[adj_u] = through;
+        tree->successors[adj_u] = v;
+        tree->edges[adj_u] = e;
+        heap_push_or_decrease(&heap, adj_u, tree->distance);
+      }
+    }
+  }
+
+  free(heap.nodes);
+  free(heap.position);
+}
+
+// The backward search of build_sink_tree_heap() on Dial's buckets, kept as
+// in dijkstra_bucket().
+void build_sink_tree_bucket(SinkTree *tree, int sink, const Graph *graph)
+{
+  int num_buckets = graph->max_weight + 1;
+  int *head = (int *)malloc(num_buckets * sizeof(int));
+  int *next = (int *)malloc(graph->num_nodes * sizeof(int));
+  int *prev = (int *)malloc(graph->num_nodes * sizeof(int));
+  int *distance = tree->distance;
+  memset(head, -1, num_buckets * sizeof(int));
+
+  clear_sink_tree(tree, sink, graph);
+  head[0] = sink;
+  next[sink] = -1;
+  prev[sink] = -1;
+  int queued = 1;
+  int curr_distance = 0;
+
+  while (queued > 0)
+  {
+    int b = curr_distance % num_buckets;
+    if (head[b] == -1)
+    {
+      curr_distance++;
+      continue;
+    }
+
+    int v = head[b];
+    head[b] = next[v];
+    if (next[v] != -1)
+      prev[next[v]] = -1;
+    queued--;
+
+    for (int r = graph->rev_offsets[v]; r < graph->rev_offsets[v + 1]; r++)
+    {
+      int adj_u = graph->rev_sources[r];
+      int e = graph->rev_edges[r];
+
+      int through = add_cost(distance[v], graph->weights[e]);
+      if (through < distance[adj_u])
+      {
+        if (distance[adj_u] != INF) // unlink from its old bucket
+        {
+          if (prev[adj_u] != -1)
+            next[prev[adj_u]] = next[adj_u];
+          else
+            head[distance[adj_u] % num_buckets] = next[adj_u];
+          if (next[adj_u] != -1)
+            prev[next[adj_u]] = prev[adj_u];
+          queued--;
+        }
+
+        distance[adj_u] = through;
+        tree->successors[adj_u] = v;
+        tree->edges[adj_u] = e;
+
+        int nb = distance[adj_u] % num_buckets;
+        prev[adj_u] = -1;
+        next[adj_u] = head[nb];
+        if (head[nb] != -1)
+          prev[head[nb]] = adj_u;
+        head[nb] = adj_u;
+        queued++;
+      }
+    }
+  }
+
+  free(head);
+  free(next);
+  free(prev);
+}
+
+// Builds the tree with the bucket queue if that is the engine and the
+// weights allow it, and with the heap otherwise: the scan and bidirectional
+// engines only make sense between two nodes.
+void build_sink_tree(SinkTree *tree, int sink, const Graph *graph)
+{
+  if (dijkstra_engine == DIJKSTRA_BUCKET && graph->max_weight <= MAX_BUCKET_WEIGHT)
+    build_sink_tree_bucket(tree, sink, graph);
+  else
+    build_sink_tree_heap(tree, sink, graph);
+}
+
+// Whether the tree path from v to the sink avoids every ban of mask.
+int tree_path_clear(int v, const SinkTree *tree, const SearchMask *mask)
+{
+  for (; mask != NULL && v != tree->sink; v = tree->successors[v])
+  {
+    if (edge_banned(mask, tree->edges[v]) || node_banned(mask, tree->successors[v]))
+      return 0;
+  }
+  return 1;
+}
+
+// The heap engine guided by a sink tree: an A* search with the tree
+// distance as its heuristic, which is consistent as bans only remove edges,
+// so the first time the sink is popped its path is optimal. Nodes that
+// cannot reach the sink at all are never queued.
+void dijkstra_astar(int source, const SinkTree *tree, const Graph *graph, const SearchMask *mask,
+                    SearchScratch *scratch)
+{
+  int *distance = scratch->distance;
+  int *estimate = scratch->estimate;
+  int *predecessors = scratch->predecessors;
+  IndexedHeap *heap = &scratch->heap;
+
+  // the heap is ordered by estimate = distance + distance left to the sink
+  distance[source] = 0;
+  estimate[source] = tree->distance[source];
+  heap_push_or_decrease(heap, source, estimate);
+
+  while (heap->size > 0)
+  {
+    int u = heap_pop(heap, estimate);
+    if (u == tree->sink)
+      break;
+
+    for (int e = graph->offsets[u]; e < graph->offsets[u + 1]; e++)
+    {
+      int adj_v = graph->targets[e];
+      int weight = graph->weights[e];
+
+      if (tree->distance[adj_v] == INF || edge_banned(mask, e) || node_banned(mask, adj_v))
+        continue;
+
+      touch_node(scratch, adj_v);
+      int through = add_cost(distance[u], weight);
+      if (add_cost(through, tree->distance[adj_v]) < INF && through < distance[adj_v])
+      {
+        distance[adj_v] = through;
+        estimate[adj_v] = through + tree->distance[adj_v];
+        predecessors[adj_v] = u;
+        heap_push_or_decrease(heap, adj_v, estimate);
+      }
+    }
+  }
+}
+
+// Shortest path from source to sink with the engine chosen by
+// dijkstra_engine, ignoring the nodes and edges banned by mask (may be NULL).
+// The search stops as soon as the sink is settled and runs in scratch, which
+// belongs to the calling thread, so apart from the scan engine it costs as
+// much as the nodes it reaches. shortest_path (room for num_nodes entries)
+// receives the node sequence and path_length its length, 0 if sink is
+// unreachable. Returns the path cost or INF.
+//
+// tree may be NULL, or the sink tree of sink to guide the search: bans only
+// remove edges, so tree distances are lower bounds, and if the tree path
+// from source avoids every ban it is the answer and is returned without a
+// search. Otherwise the heap engine runs as A* over the tree distances and
+// the other engines search as without a tree.
+int dijkstra(int source, int sink, const Graph *graph, const SearchMask *mask, const SinkTree *tree,
+             SearchScratch *scratch, int shortest_path[], int *path_length)
+{
+  *path_length = 0;
+  if (tree != NULL)
+  {
+    if (tree->distance[source] == INF)
+      return INF;
+
+    if (tree_path_clear(source, tree, mask))
+    {
+      int length = 0;
+      for (int v = source; v != sink; v = tree->successors[v])
+      {
+        shortest_path[length++] = v;
+      }
+      shortest_path[length++] = sink;
+      *path_length = length;
+      return tree->distance[source];
+    }
+  }
+
+  begin_search(scratch, graph->num_nodes);
+  touch_node(scratch, source);
+  touch_node(scratch, sink);
+
+  if (dijkstra_engine == DIJKSTRA_SCAN)
+    dijkstra_scan(source, sink, graph, mask, scratch);
+  else if (dijkstra_engine == DIJKSTRA_BUCKET && graph->max_weight <= MAX_BUCKET_WEIGHT)
+    dijkstra_bucket(source, sink, graph, mask, graph->max_weight, scratch);
+  else if (dijkstra_engine == DIJKSTRA_BIDIR)
+    dijkstra_bidirectional(source, sink, graph, mask, tree != NULL ? tree->distance : NULL, scratch);
+  else if (tree != NULL)
+    dijkstra_astar(source, tree, graph, mask, scratch);
+  else
+    dijkstra_heap(source, sink, graph, mask, scratch);
+
+  int cost = scratch->distance[sink];
+  if (cost != INF)
+  {
+    *path_length = save_shortest_path(source, sink, scratch->predecessors, shortest_path);
+  }
+  return cost;
+}
+
+// Classes of classify_tree_path(), 0 for nodes not classified yet.
+#define TREE_PATH_CLEAR 1
+#define TREE_PATH_BLOCKED 2
+
+// Returns whether the tree path from v to the sink avoids every ban of mask,
+// memoizing the answer in the classes of scratch for v and every node walked
+// through, so each node is walked at most once per search.
+int classify_tree_path(int v, const SinkTree *tree, const SearchMask *mask, SearchScratch *scratch)
+{
+  char *classes = scratch->classes;
+  int result = TREE_PATH_CLEAR, stop = v;
+  touch_node(scratch, stop);
+  while (stop != tree->sink && classes[stop] == 0)
+  {
+    if (edge_banned(mask, tree->edges[stop]) || node_banned(mask, tree->successors[stop]))
+    {
+      result = TREE_PATH_BLOCKED;
+      break;
+    }
+    stop = tree->successors[stop];
+    touch_node(scratch, stop);
+  }
+  if (classes[stop] != 0)
+    result = classes[stop];
+
+  for (int u = v; u != stop; u = tree->successors[u])
+  {
+    classes[u] = result;
+  }
+  classes[stop] = result;
+  return result;
+}
+
+// The guided search of dijkstra() with postponed node classification (after
+// Feng), always on the heap: a
+// popped node whose tree path avoids every ban ends the search, since its
+// estimate is then the cost of a real path and no queued node estimates
+// less. Nodes are only classified when popped, so a spur search that leaves
+// the tree close to the sink settles a handful of nodes instead of running
+// until the sink. The first popped node whose tree path is clear cannot
+// share a node with its own search path, or that node would have been
+// popped, and found clear, before it.
+int dijkstra_classified(int source, const SinkTree *tree, const Graph *graph, const SearchMask *mask,
+                        SearchScratch *scratch, int shortest_path[], int *path_length)
+{
+  if (mask == NULL)
+    return dijkstra(source, tree->sink, graph, mask, tree, scratch, shortest_path, path_length);
+
+  *path_length = 0;
+  if (tree->distance[source] == INF)
+    return INF;
+
+  int *distance = scratch->distance;
+  int *estimate = scratch->estimate;
+  int *predecessors = scratch->predecessors;
+  IndexedHeap *heap = &scratch->heap;
+  begin_search(scratch, graph->num_nodes);
+
+  touch_node(scratch, source);
+  distance[source] = 0;
+  estimate[source] = tree->distance[source];
+  heap_push_or_decrease(heap, source, estimate);
+
+  int cost = INF;
+  while (heap->size > 0)
+  {
+    int u = heap_pop(heap, estimate);
+    if (classify_tree_path(u, tree, mask, scratch) == TREE_PATH_CLEAR)
+    {
+      // the search path to u, then the tree path on to the sink
+      int length = save_shortest_path(source, u, predecessors, shortest_path);
+      for (int v = u; v != tree->sink; v = tree->successors[v])
+      {
+        shortest_path[length++] = tree->successors[v];
+      }
+      *path_length = length;
+      cost = estimate[u];
+      break;
+    }
+
+    for (int e = graph->offsets[u]; e < graph->offsets[u + 1]; e++)
+    {
+      int adj_v = graph->targets[e];
+      int weight = graph->weights[e];
+
+      if (tree->distance[adj_v] == INF || edge_banned(mask, e) || node_banned(mask, adj_v))
+        continue;
+
+      touch_node(scratch, adj_v);
+      int through = add_cost(distance[u], weight);
+      if (add_cost(through, tree->distance[adj_v]) < INF && through < distance[adj_v])
+      {
+        distance[adj_v] = through;
+        estimate[adj_v] = through + tree->distance[adj_v];
+        predecessors[adj_v] = u;
+        heap_push_or_decrease(heap, adj_v, estimate);
+      }
+    }
+  }
+
+  return cost;
+}
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef EPPSTEIN_H
+#define EPPSTEIN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "queue.h"
+#include "graph.h"
+#include "dijkstra.h"
+#include "path.h"
+#include "yen.h"
+
+// K shortest walks in the style of Eppstein, with lazily explored
+// persistent heaps. Walks may repeat nodes, so this answers a different
+// question than Yen's loopless paths, in O(E log V + K log K) after one
+// backward search from the sink.
+//
+// With d(v) the distance of v to the sink, every edge u -> v that is not a
+// tree edge is a sidetrack of extra cost w + d(v) - d(u) >= 0, and every
+// walk is the tree path from the source with a sequence of sidetracks taken
+// on the way. H(v) is a heap of all sidetracks leaving the tree path of v;
+// it shares everything but O(log V) nodes per sidetrack with H(next(v)).
+// A walk's successors either swap its last sidetrack for a child in the
+// heap it came from or add the best sidetrack of H(head), so each returned
+// walk queues at most three more.
+
+// Node of a persistent leftist heap of sidetracks, ordered by key.
+typedef struct
+{
+  int key;
+  int tail;
+  int head;
+  int left;
+  int right;
+  int rank;
+} SidetrackNode;
+
+typedef struct
+{
+  SidetrackNode *nodes;
+  int size;
+  int capacity;
+} SidetrackPool;
+
+int new_sidetrack_node(SidetrackPool *pool, SidetrackNode node)
+{
+  if (pool->size == pool->capacity)
+  {
+    pool->capacity *= 2;
+    pool->nodes = (SidetrackNode *)realloc(pool->nodes, pool->capacity * sizeof(SidetrackNode));
+  }
+  pool->nodes[pool->size] = node;
+  return pool->size++;
+}
+
+int sidetrack_rank(SidetrackPool *pool, int h)
+{
+  return h == -1 ? 0 : pool->nodes[h].rank;
+}
+
+// Melds heaps a and b without changing either: only the nodes on the right
+// spine of the result are copied.
+int meld_sidetracks(SidetrackPool *pool, int a, int b)
+{
+  if (a == -1)
+    return b;
+  if (b == -1)
+    return a;
+  if (pool->nodes[b].key < pool->nodes[a].key)
+  {
+    int temp = a;
+    a = b;
+    b = temp;
+  }
+
+  int copy = new_sidetrack_node(pool, pool->nodes[a]);
+  int right = meld_sidetracks(pool, pool->nodes[copy].right, b);
+  pool->nodes[copy].right = right;
+  if (sidetrack_rank(pool, pool->nodes[copy].left) < sidetrack_rank(pool, right))
+  {
+    pool->nodes[copy].right = pool->nodes[copy].left;
+    pool->nodes[copy].left = right;
+  }
+  pool->nodes[copy].rank = sidetrack_rank(pool, pool->nodes[copy].right) + 1;
+  return copy;
+}
+
+// Starts the sidetrack heaps of a query: every heap_root[v] of ws becomes
+// unbuilt without touching it.
+void begin_sidetrack_heaps(YenWorkspace *ws, int num_nodes)
+{
+  if (ws->heap_root == NULL)
+  {
+    ws->heap_root = (int *)malloc(num_nodes * sizeof(int));
+    ws->heap_stamp = (unsigned int *)calloc(num_nodes, sizeof(unsigned int));
+    ws->heap_stack = (int *)malloc(num_nodes * sizeof(int));
+  }
+  ws->heap_generation++;
+  if (ws->heap_generation == 0)
+  {
+    // the stamps wrapped around: clear them once every 2^32 queries
+    memset(ws->heap_stamp, 0, num_nodes * sizeof(unsigned int));
+    ws->heap_generation = 1;
+  }
+}
+
+// Returns H(u) for the sink tree of ws, building it and the missing heaps
+// further down the tree path of u first.
+int sidetrack_heap(const Graph *graph, YenWorkspace *ws, SidetrackPool *pool, int u)
+{
+  const SinkTree *tree = ws->tree;
+  int *heap_root = ws->heap_root;
+  int *stack = ws->heap_stack;
+
+  int top = 0;
+  for (int v = u; ws->heap_stamp[v] != ws->heap_generation; v = tree->successors[v])
+  {
+    stack[top++] = v;
+    if (v == tree->sink)
+      break;
+  }
+
+  while (top > 0)
+  {
+    int v = stack[--top];
+    int h = v == tree->sink ? -1 : heap_root[tree->successors[v]];
+
+    for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; e++)
+    {
+      int w = graph->targets[e];
+      if (tree->distance[w] == INF || e == tree->edges[v])
+        continue;
+
+      // a sidetrack costing INF or more leads to walks out of range
+      int through = add_cost(graph->weights[e], tree->distance[w]);
+      SidetrackNode node = {through == INF ? INF : through - tree->distance[v], v, w, -1, -1, 1};
+      h = meld_sidetracks(pool, h, new_sidetrack_node(pool, node));
+    }
+    heap_root[v] = h;
+    ws->heap_stamp[v] = ws->heap_generation;
+  }
+  return heap_root[u];
+}
+
+// A walk is the heap node of its last sidetrack and the walk it branched
+// from (prev, -1 for the tree path).
+typedef struct
+{
+  int *heap_node;
+  int *prev;
+  int size;
+  int capacity;
+} WalkStates;
+
+int add_walk_state(WalkStates *states, int heap_node, int prev)
+{
+  if (states->size == states->capacity)
+  {
+    states->capacity *= 2;
+    states->heap_node = (int *)realloc(states->heap_node, states->capacity * sizeof(int));
+    states->prev = (int *)realloc(states->prev, states->capacity * sizeof(int));
+  }
+  states->heap_node[states->size] = heap_node;
+  states->prev[states->size] = prev;
+  return states->size++;
+}
+
+// Finds up to K shortest source -> sink walks in increasing cost, filling
+// K_paths like yen_k_shortest_paths() and returning the number found.
+int lazy_k_shortest_walks(const Graph *graph, int source, int sink, int K, YenWorkspace *ws, PathCostPair K_paths[])
+{
+  reset_path_arena(&ws->arena);
+  ws->pq.size = 0;
+  ws->pq.limit = 0;
+
+  ws->tree = sink_tree(&ws->trees, sink, graph);
+  const int *distance = ws->tree->distance;
+  if (distance[source] == INF)
+    return 0;
+
+  int num_nodes = graph->num_nodes;
+
+  // heaps are built on first use, so only the tree paths that walks
+  // actually leave from are ever looked at
+  SidetrackPool pool;
+  pool.capacity = 1024;
+  pool.size = 0;
+  pool.nodes = (SidetrackNode *)malloc(pool.capacity * sizeof(SidetrackNode));
+
+  begin_sidetrack_heaps(ws, num_nodes);
+
+  WalkStates states;
+  states.capacity = 64;
+  states.size = 0;
+  states.heap_node = (int *)malloc(states.capacity * sizeof(int));
+  states.prev = (int *)malloc(states.capacity * sizeof(int));
+
+  int walk_capacity = num_nodes;
+  int *walk = (int *)malloc(walk_capacity * sizeof(int));
+  int *sidetracks = NULL;
+  int sidetracks_capacity = 0;
+
+  int found = 0;
+  int state = -1; // the tree path
+  int cost = distance[source];
+
+  while (1)
+  {
+    // the sidetracks of the walk, first one first
+    int num_sidetracks = 0;
+    for (int s = state; s != -1; s = states.prev[s])
+      num_sidetracks++;
+    if (num_sidetracks > sidetracks_capacity)
+    {
+      sidetracks_capacity = 2 * num_sidetracks;
+      sidetracks = (int *)realloc(sidetracks, sidetracks_capacity * sizeof(int));
+    }
+    int n = num_sidetracks;
+    for (int s = state; s != -1; s = states.prev[s])
+      sidetracks[--n] = states.heap_node[s];
+
+    // follow the tree, leaving it at every sidetrack
+    int length = 0, u = source;
+    for (int i = 0; i <= num_sidetracks; i++)
+    {
+      int stop = i < num_sidetracks ? pool.nodes[sidetracks[i]].tail : sink;
+      while (1)
+      {
+        if (length == walk_capacity)
+        {
+          walk_capacity *= 2;
+          walk = (int *)realloc(walk, walk_capacity * sizeof(int));
+        }
+        walk[length++] = u;
+        if (u == stop)
+          break;
+        u = ws->tree->successors[u];
+      }
+      if (i < num_sidetracks)
+        u = pool.nodes[sidetracks[i]].head;
+    }
+
+    K_paths[found].handle = add_path(&ws->arena, walk, length);
+    K_paths[found].cost = cost;
+    found++;
+    if (found == K)
+      break;
+
+    // next walks: swap the last sidetrack for one of its heap children, or
+    // take another sidetrack after it
+    PathCostPair pair;
+    if (state == -1)
+    {
+      int root = sidetrack_heap(graph, ws, &pool, source);
+      if (root != -1 && add_cost(cost, pool.nodes[root].key) != INF)
+      {
+        pair.handle = add_walk_state(&states, root, -1);
+        pair.cost = cost + pool.nodes[root].key;
+        insert(&ws->pq, pair);
+      }
+    }
+    else
+    {
+      SidetrackNode h = pool.nodes[states.heap_node[state]];
+      int children[2] = {h.left, h.right};
+      for (int c = 0; c < 2; c++)
+      {
+        if (children[c] == -1 || add_cost(cost - h.key, pool.nodes[children[c]].key) == INF)
+          continue;
+        pair.cost = cost - h.key + pool.nodes[children[c]].key;
+        pair.handle = add_walk_state(&states, children[c], states.prev[state]);
+        insert(&ws->pq, pair);
+      }
+
+      int next = sidetrack_heap(graph, ws, &pool, h.head);
+      if (next != -1 && add_cost(cost, pool.nodes[next].key) != INF)
+      {
+        pair.cost = cost + pool.nodes[next].key;
+        pair.handle = add_walk_state(&states, next, state);
+        insert(&ws->pq, pair);
+      }
+    }
+
+    if (ws->pq.size == 0)
+      break;
+
+    // only the best K - found queued walks can still be returned
+    set_queue_limit(&ws->pq, K - found);
+    pair = extractMin(&ws->pq);
+    state = pair.handle;
+    cost = pair.cost;
+  }
+
+  free(pool.nodes);
+  free(states.heap_node);
+  free(states.prev);
+  free(walk);
+  free(sidetracks);
+  return found;
+}
+
+#endif
@@ -0,0 +1,737 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Compressed sparse row graph: the out-edges of node u are
+// targets[offsets[u]] .. targets[offsets[u + 1] - 1] with matching weights.
+// The reverse adjacency lists the in-edges of v the same way:
+// rev_sources[rev_offsets[v]] .. are their tails and rev_edges the indices
+// of the same edges in targets/weights, so searches running backwards see
+// the same weights and edge bans. All six arrays are consecutive parts of
+// one buffer, data, so the whole graph can be sent in one message or placed
+// in shared memory. Graphs read from a binary file point into the read-only
+// mapping of the file and may carry node names, names + name_offsets[u]
+// for node u.
+typedef struct
+{
+  int num_nodes;
+  int num_edges;
+  int max_weight;
+  int *data;
+  int *offsets;
+  int *targets;
+  int *weights;
+  int *rev_offsets;
+  int *rev_sources;
+  int *rev_edges;
+  long long *name_offsets;
+  char *names;
+  void *mapping;
+  size_t mapped_size;
+} Graph;
+
+// Number of ints in the data buffer of a graph.
+size_t graph_data_size(int num_nodes, int num_edges)
+{
+  return 2 * ((size_t)num_nodes + 1) + 4 * (size_t)num_edges;
+}
+
+// Points the CSR arrays of graph into data, which is owned by the caller.
+void attach_graph(Graph *graph, int num_nodes, int num_edges, int *data)
+{
+  graph->num_nodes = num_nodes;
+  graph->num_edges = num_edges;
+  graph->data = data;
+  graph->offsets = data;
+  graph->targets = data + num_nodes + 1;
+  graph->weights = graph->targets + num_edges;
+  graph->rev_offsets = graph->weights + num_edges;
+  graph->rev_sources = graph->rev_offsets + num_nodes + 1;
+  graph->rev_edges = graph->rev_sources + num_edges;
+  graph->name_offsets = NULL;
+  graph->names = NULL;
+  graph->mapping = NULL;
+  graph->mapped_size = 0;
+}
+
+void allocate_graph(Graph *graph, int num_nodes, int num_edges)
+{
+  attach_graph(graph, num_nodes, num_edges, (int *)calloc(graph_data_size(num_nodes, num_edges), sizeof(int)));
+  graph->max_weight = 0;
+}
+
+void free_graph(Graph *graph)
+{
+  if (graph->mapping != NULL)
+    munmap(graph->mapping, graph->mapped_size);
+  else
+    free(graph->data);
+  graph->mapping = NULL;
+  graph->data = NULL;
+  graph->name_offsets = NULL;
+  graph->names = NULL;
+  graph->offsets = NULL;
+  graph->targets = NULL;
+  graph->weights = NULL;
+  graph->rev_offsets = NULL;
+  graph->rev_sources = NULL;
+  graph->rev_edges = NULL;
+}
+
+int graph_threads()
+{
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+// Stable counting sort of num_items items by their key in [0, num_keys):
+// fills offsets (num_keys + 1 entries) with the start of each key and
+// order with the items, key by key, in their original order within a key.
+// Each thread counts and then places one contiguous slice of the items; the
+// slots of a key are split between threads in slice order, which keeps the
+// sort stable. The per-thread counts take threads * num_keys ints.
+void sort_by_key(int num_keys, int num_items, const int keys[], int offsets[], int order[])
+{
+  int max_threads = graph_threads();
+  int *counts = (int *)calloc((size_t)max_threads * num_keys + 1, sizeof(int));
+  offsets[0] = 0;
+
+  #pragma omp parallel num_threads(max_threads)
+  {
+#ifdef _OPENMP
+    int thread = omp_get_thread_num();
+    int num_threads = omp_get_num_threads();
+#else
+    int thread = 0;
+    int num_threads = 1;
+#endif
+    int first = (int)((long long)num_items * thread / num_threads);
+    int last = (int)((long long)num_items * (thread + 1) / num_threads);
+    int *count = counts + (size_t)thread * num_keys;
+
+    for (int i = first; i < last; i++)
+    {
+      count[keys[i]]++;
+    }
+
+    #pragma omp barrier
+
+    // turn the counts of each key into the start of every thread's slots
+    // within the key, and the key sizes into offsets
+    #pragma omp for
+    for (int k = 0; k < num_keys; k++)
+    {
+      int running = 0;
+      for (int t = 0; t < num_threads; t++)
+      {
+        int c = counts[(size_t)t * num_keys + k];
+        counts[(size_t)t * num_keys + k] = running;
+        running += c;
+      }
+      offsets[k + 1] = running;
+    }
+
+    #pragma omp single
+    {
+      for (int k = 0; k < num_keys; k++)
+      {
+        offsets[k + 1] += offsets[k];
+      }
+    }
+
+    for (int i = first; i < last; i++)
+    {
+      order[offsets[keys[i]] + count[keys[i]]++] = i;
+    }
+  }
+
+  free(counts);
+}
+
+int compare_edge_targets(const void *a, const void *b)
+{
+  const int *x = (const int *)a, *y = (const int *)b;
+  if (x[0] != y[0])
+    return x[0] < y[0] ? -1 : 1;
+  return x[1] < y[1] ? -1 : (x[1] > y[1]);
+}
+
+// Marks in keep[] the last of every run of edges u -> v with the same u and
+// v among the rows of an edge list sorted by source (order and offsets as
+// left by sort_by_key()), and returns how many edges are kept.
+int mark_last_edges(int num_nodes, const int offsets[], const int order[], const int to[], char keep[])
+{
+  int kept = 0;
+
+  #pragma omp parallel reduction(+:kept)
+  {
+    int *pairs = NULL;  // (target, position) of the edges of one row
+    int capacity = 0;
+
+    #pragma omp for schedule(dynamic, 1024)
+    for (int u = 0; u < num_nodes; u++)
+    {
+      int degree = offsets[u + 1] - offsets[u];
+      if (degree > capacity)
+      {
+        capacity = degree;
+        pairs = (int *)realloc(pairs, 2 * (size_t)capacity * sizeof(int));
+      }
+      for (int i = 0; i < degree; i++)
+      {
+        pairs[2 * i] = to[order[offsets[u] + i]];
+        pairs[2 * i + 1] = offsets[u] + i;
+      }
+      qsort(pairs, degree, 2 * sizeof(int), compare_edge_targets);
+
+      for (int i = 0; i < degree; i++)
+      {
+        int last = i + 1 == degree || pairs[2 * i + 2] != pairs[2 * i];
+        keep[pairs[2 * i + 1]] = last;
+        kept += last;
+      }
+    }
+    free(pairs);
+  }
+  return kept;
+}
+
+// Builds the CSR arrays from an unordered edge list with a counting sort on
+// the source node, so edges of the same row keep their input order, and the
+// reverse adjacency with a second one on the target node. An edge u -> v
+// given more than once is kept once, with the weight of its last line, as
+// in the adjacency matrix the CSR form replaced: parallel edges would let a
+// spur search come back through a copy of the edge Yen just banned.
+void build_graph(Graph *graph, int num_nodes, int num_edges, int from[], int to[], int weight[])
+{
+  int *order = (int *)malloc((num_edges > 0 ? num_edges : 1) * sizeof(int));
+  int *offsets = (int *)malloc(((size_t)num_nodes + 1) * sizeof(int));
+  char *keep = (char *)malloc(num_edges > 0 ? num_edges : 1);
+
+  sort_by_key(num_nodes, num_edges, from, offsets, order);
+  int kept = mark_last_edges(num_nodes, offsets, order, to, keep);
+
+  allocate_graph(graph, num_nodes, kept);
+  graph->offsets[0] = 0;
+  #pragma omp parallel for
+  for (int u = 0; u < num_nodes; u++)
+  {
+    int row_kept = 0;
+    for (int i = offsets[u]; i < offsets[u + 1]; i++)
+      row_kept += keep[i];
+    graph->offsets[u + 1] = row_kept;
+  }
+  for (int u = 0; u < num_nodes; u++)
+  {
+    graph->offsets[u + 1] += graph->offsets[u];
+  }
+
+  int max_weight = 0;
+
+  #pragma omp parallel for reduction(max:max_weight)
+  for (int u = 0; u < num_nodes; u++)
+  {
+    int e = graph->offsets[u];
+    for (int i = offsets[u]; i < offsets[u + 1]; i++)
+    {
+      if (!keep[i])
+        continue;
+      graph->targets[e] = to[order[i]];
+      graph->weights[e] = weight[order[i]];
+      if (weight[order[i]] > max_weight)
+        max_weight = weight[order[i]];
+      e++;
+    }
+  }
+  graph->max_weight = max_weight;
+  free(offsets);
+  free(keep);
+  num_edges = kept;
+
+  sort_by_key(num_nodes, num_edges, graph->targets, graph->rev_offsets, graph->rev_edges);
+
+  // order now maps every edge to its source node
+  #pragma omp parallel for
+  for (int u = 0; u < num_nodes; u++)
+  {
+    for (int e = graph->offsets[u]; e < graph->offsets[u + 1]; e++)
+      order[e] = u;
+  }
+
+  #pragma omp parallel for
+  for (int r = 0; r < num_edges; r++)
+  {
+    graph->rev_sources[r] = order[graph->rev_edges[r]];
+  }
+
+  free(order);
+}
+
+// Binary graph files start with this header, followed by the data buffer
+// of the graph (offsets, targets, weights and the reverse adjacency) and, when names_size is not 0,
+// num_nodes + 1 name offsets (8-byte aligned) and names_size bytes of
+// NUL-terminated names. Everything is stored in the byte order of the machine that wrote it.
+#define GRAPH_MAGIC "KSPGRAPH"
+#define GRAPH_VERSION 2
+
+typedef struct
+{
+  char magic[8];
+  int version;
+  int num_nodes;
+  int num_edges;
+  int max_weight;
+  long long names_size;
+} GraphFileHeader;
+
+// Writes graph to filename in the binary format. names may be NULL, or give
+// one name per node. Returns 0 on success and -1 on error.
+int save_binary_graph(const char *filename, const Graph *graph, char *names[])
+{
+  FILE *file = fopen(filename, "wb");
+  if (file == NULL)
+  {
+    fprintf(stderr, "Error opening file %s.\n", filename);
+    return -1;
+  }
+
+  GraphFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GRAPH_MAGIC, 8);
+  header.version = GRAPH_VERSION;
+  header.num_nodes = graph->num_nodes;
+  header.num_edges = graph->num_edges;
+  header.max_weight = graph->max_weight;
+
+  long long *name_offsets = NULL;
+  if (names != NULL)
+  {
+    name_offsets = (long long *)malloc((graph->num_nodes + 1) * sizeof(long long));
+    for (int u = 0; u < graph->num_nodes; u++)
+    {
+      name_offsets[u] = header.names_size;
+      header.names_size += strlen(names[u]) + 1;
+    }
+    name_offsets[graph->num_nodes] = header.names_size;
+  }
+
+  size_t data_size = graph_data_size(graph->num_nodes, graph->num_edges);
+  int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+           fwrite(graph->data, sizeof(int), data_size, file) == data_size;
+
+  if (ok && names != NULL)
+  {
+    int zero = 0;
+    if (data_size % 2 == 1)
+      ok = fwrite(&zero, sizeof(int), 1, file) == 1;
+    ok = ok && fwrite(name_offsets, sizeof(long long), graph->num_nodes + 1, file) == (size_t)graph->num_nodes + 1;
+    for (int u = 0; ok && u < graph->num_nodes; u++)
+    {
+      ok = fwrite(names[u], 1, strlen(names[u]) + 1, file) == strlen(names[u]) + 1;
+    }
+  }
+  free(name_offsets);
+
+  if (fclose(file) != 0 || !ok)
+  {
+    fprintf(stderr, "Error writing file %s.\n", filename);
+    return -1;
+  }
+  return 0;
+}
+
+// Maps a binary graph file read-only. Nothing is parsed or copied: the CSR
+// arrays point straight into the mapping, so loading costs as much as the
+// pages that are touched, and processes on a host share those pages.
+// Returns 0 on success and -1 if the file cannot be used.
+int load_binary_graph(const char *filename, Graph *graph)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1)
+  {
+    fprintf(stderr, "Error opening file %s.\n", filename);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(GraphFileHeader))
+  {
+    fprintf(stderr, "Error reading header of %s.\n", filename);
+    close(fd);
+    return -1;
+  }
+
+  void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+  {
+    fprintf(stderr, "Error mapping file %s.\n", filename);
+    return -1;
+  }
+
+  GraphFileHeader *header = (GraphFileHeader *)mapping;
+  size_t data_size = graph_data_size(header->num_nodes, header->num_edges);
+  size_t names_start = sizeof(GraphFileHeader) + (data_size + data_size % 2) * sizeof(int);
+  size_t expected = names_start;
+  if (header->names_size > 0)
+    expected += (header->num_nodes + 1) * sizeof(long long) + header->names_size;
+
+  if (memcmp(header->magic, GRAPH_MAGIC, 8) == 0 && header->version != GRAPH_VERSION)
+  {
+    fprintf(stderr, "%s has binary graph version %d, convert it again with graphConverter.\n", filename, header->version);
+    munmap(mapping, st.st_size);
+    return -1;
+  }
+  if (memcmp(header->magic, GRAPH_MAGIC, 8) != 0 ||
+      header->num_nodes < 0 || header->num_edges < 0 || (size_t)st.st_size < expected)
+  {
+    fprintf(stderr, "%s is not a valid binary graph file.\n", filename);
+    munmap(mapping, st.st_size);
+    return -1;
+  }
+  if (header->num_nodes == 0)
+  {
+    fprintf(stderr, "%s has no nodes.\n", filename);
+    munmap(mapping, st.st_size);
+    return -1;
+  }
+
+  attach_graph(graph, header->num_nodes, header->num_edges, (int *)((char *)mapping + sizeof(GraphFileHeader)));
+  graph->max_weight = header->max_weight;
+  graph->mapping = mapping;
+  graph->mapped_size = st.st_size;
+
+  if (header->names_size > 0)
+  {
+    graph->name_offsets = (long long *)((char *)mapping + names_start);
+    graph->names = (char *)(graph->name_offsets + header->num_nodes + 1);
+  }
+  return 0;
+}
+
+// Whether filename starts with the magic of the binary format.
+int is_binary_graph(const char *filename)
+{
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL)
+    return 0;
+
+  char magic[8];
+  int binary = fread(magic, 1, 8, file) == 8 && memcmp(magic, GRAPH_MAGIC, 8) == 0;
+  fclose(file);
+  return binary;
+}
+
+// Edges parsed by one thread.
+typedef struct
+{
+  int *from;
+  int *to;
+  int *weight;
+  int count;
+  int capacity;
+  int max_node;
+  int lines;         // lines read, up to and including a bad one
+  const char *error; // why the last line read was rejected, or NULL
+} EdgeList;
+
+// Reads a decimal int at *cursor, after any blanks, and moves the cursor
+// past it. Returns 0 if there is no number before the end of the line and
+// -1 if the number does not fit in an int.
+int parse_int(const char **cursor, const char *end, int *value)
+{
+  const char *c = *cursor;
+  while (c < end && (*c == ' ' || *c == '\t' || *c == '\r'))
+    c++;
+
+  int negative = 0;
+  if (c < end && (*c == '-' || *c == '+'))
+    negative = *c++ == '-';
+
+  if (c == end || *c < '0' || *c > '9')
+    return 0;
+
+  // the accumulator stops growing past the limit, so long digit runs
+  // cannot overflow it
+  long long limit = negative ? (long long)INT_MAX + 1 : INT_MAX;
+  long long number = 0;
+  while (c < end && *c >= '0' && *c <= '9')
+  {
+    number = number * 10 + (*c++ - '0');
+    if (number > limit)
+      number = limit + 1;
+  }
+
+  *cursor = c;
+  if (number > limit)
+    return -1;
+  *value = (int)(negative ? -number : number);
+  return 1;
+}
+
+// Parses the "from to weight" lines in [start, end) into edges, with the
+// same filtering as load_graph(). Stops at the first line with a number out
+// of range or a negative weight and sets edges->error; edges->lines then
+// counts the lines up to and including that one.
+void parse_edges(const char *start, const char *end, EdgeList *edges)
+{
+  edges->capacity = 1024;
+  edges->count = 0;
+  edges->max_node = -1;
+  edges->lines = 0;
+  edges->error = NULL;
+  edges->from = (int *)malloc(edges->capacity * sizeof(int));
+  edges->to = (int *)malloc(edges->capacity * sizeof(int));
+  edges->weight = (int *)malloc(edges->capacity * sizeof(int));
+
+  const char *line = start;
+  while (line < end)
+  {
+    const char *line_end = (const char *)memchr(line, '\n', end - line);
+    if (line_end == NULL)
+      line_end = end;
+
+    const char *cursor = line;
+    int from_node, to_node, w;
+    int parsed = parse_int(&cursor, line_end, &from_node);
+    if (parsed == 1)
+      parsed = parse_int(&cursor, line_end, &to_node);
+    if (parsed == 1)
+      parsed = parse_int(&cursor, line_end, &w);
+    line = line_end + 1;
+    edges->lines++;
+
+    if (parsed == 0)
+      continue;
+    // node ids must leave room for the node count and weights must stay
+    // below INT_MAX, the cost of an unreachable node
+    if (parsed == -1 || from_node == INT_MAX || to_node == INT_MAX || w == INT_MAX)
+    {
+      edges->error = "number out of range";
+      return;
+    }
+    if (w < 0)
+    {
+      edges->error = "negative edge weight";
+      return;
+    }
+    if (from_node < 0 || to_node < 0)
+    {
+      fprintf(stderr, "Skipping edge %d -> %d with a negative node id.\n", from_node, to_node);
+      continue;
+    }
+    if (w == 0)
+      continue;
+
+    if (edges->count == edges->capacity)
+    {
+      edges->capacity *= 2;
+      edges->from = (int *)realloc(edges->from, edges->capacity * sizeof(int));
+      edges->to = (int *)realloc(edges->to, edges->capacity * sizeof(int));
+      edges->weight = (int *)realloc(edges->weight, edges->capacity * sizeof(int));
+    }
+    edges->from[edges->count] = from_node;
+    edges->to[edges->count] = to_node;
+    edges->weight[edges->count] = w;
+    edges->count++;
+
+    if (from_node > edges->max_node)
+      edges->max_node = from_node;
+    if (to_node > edges->max_node)
+      edges->max_node = to_node;
+  }
+}
+
+// Returns the first line start at or after p in the body of size bytes:
+// p itself if it is the start of the body or follows a newline.
+const char *next_line_start(const char *body, size_t size, const char *p)
+{
+  if (p == body)
+    return p;
+  const char *newline = (const char *)memchr(p - 1, '\n', body + size - (p - 1));
+  return newline != NULL ? newline + 1 : body + size;
+}
+
+// Reads a mapped-*.txt edge list: a "Total Edges: E, Total Unique Nodes: N"
+// line, a column header line, then "from to weight" per line. The node count
+// comes from the first line, or from the largest node id if it is missing.
+// Edges with weight 0 are skipped, as 0 meant "no edge" in the old adjacency
+// matrix, and so are lines that do not hold three numbers. Negative weights
+// and numbers that do not fit (weights must stay below INT_MAX) fail the
+// load with the line number. The edge lines
+// are read in one go and split into one range per OpenMP thread at line
+// boundaries; the threads parse their ranges concurrently and the edges are
+// joined in file order. Binary graph files are recognised by their magic and
+// mapped instead. Returns 0 on success and -1 if the file cannot be used.
+int load_graph(const char *filename, Graph *graph)
+{
+  if (is_binary_graph(filename))
+    return load_binary_graph(filename, graph);
+
+  FILE *file = fopen(filename, "r");
+  if (file == NULL)
+  {
+    fprintf(stderr, "Error opening file %s.\n", filename);
+    return -1;
+  }
+
+  // The first line carries the counts, the second one names the columns
+  char line[256];
+  int header_edges = 0, header_nodes = 0;
+  if (fgets(line, sizeof(line), file) == NULL)
+  {
+    fprintf(stderr, "Error reading header of %s.\n", filename);
+    fclose(file);
+    return -1;
+  }
+  if (sscanf(line, "Total Edges: %d, Total Unique Nodes: %d", &header_edges, &header_nodes) != 2)
+  {
+    header_edges = 0;
+    header_nodes = 0;
+  }
+  if (fgets(line, sizeof(line), file) == NULL)
+  {
+    fprintf(stderr, "Error reading header of %s.\n", filename);
+    fclose(file);
+    return -1;
+  }
+
+  long body_start = ftell(file);
+  fseek(file, 0, SEEK_END);
+  size_t size = ftell(file) - body_start;
+  fseek(file, body_start, SEEK_SET);
+
+  char *body = (char *)malloc(size + 1);
+  if (fread(body, 1, size, file) != size)
+  {
+    fprintf(stderr, "Error reading %s.\n", filename);
+    free(body);
+    fclose(file);
+    return -1;
+  }
+  fclose(file);
+
+  int max_threads = graph_threads();
+  EdgeList *lists = (EdgeList *)malloc(max_threads * sizeof(EdgeList));
+  int num_threads = 1;
+
+  #pragma omp parallel num_threads(max_threads)
+  {
+#ifdef _OPENMP
+    int thread = omp_get_thread_num();
+    #pragma omp single
+    num_threads = omp_get_num_threads();
+#else
+    int thread = 0;
+#endif
+    // ranges start after the first newline past their nominal start, so
+    // every line belongs to the range its first byte falls in
+    const char *start = body + size * thread / num_threads;
+    const char *end = body + size * (thread + 1) / num_threads;
+    if (thread > 0)
+      start = next_line_start(body, size, start);
+    if (thread < num_threads - 1)
+      end = next_line_start(body, size, end);
+    if (start > end)
+      start = end;
+
+    parse_edges(start, end, &lists[thread]);
+  }
+  free(body);
+
+  // report the first bad line in file order; the body starts on line 3
+  int line_number = 2;
+  for (int t = 0; t < num_threads; t++)
+  {
+    line_number += lists[t].lines;
+    if (lists[t].error != NULL)
+    {
+      fprintf(stderr, "Error on line %d of %s: %s.\n", line_number, filename, lists[t].error);
+      for (int u = 0; u < num_threads; u++)
+      {
+        free(lists[u].from);
+        free(lists[u].to);
+        free(lists[u].weight);
+      }
+      free(lists);
+      return -1;
+    }
+  }
+
+  int count = 0;
+  int num_nodes = header_nodes;
+  int *first = (int *)malloc(num_threads * sizeof(int));
+  for (int t = 0; t < num_threads; t++)
+  {
+    first[t] = count;
+    count += lists[t].count;
+    if (lists[t].max_node >= num_nodes)
+      num_nodes = lists[t].max_node + 1;
+  }
+
+  // nothing can be searched, and the per-node buffers would be empty
+  if (num_nodes <= 0)
+  {
+    fprintf(stderr, "%s has no nodes.\n", filename);
+    for (int t = 0; t < num_threads; t++)
+    {
+      free(lists[t].from);
+      free(lists[t].to);
+      free(lists[t].weight);
+    }
+    free(lists);
+    free(first);
+    return -1;
+  }
+
+  int *from = (int *)malloc((count > 0 ? count : 1) * sizeof(int));
+  int *to = (int *)malloc((count > 0 ? count : 1) * sizeof(int));
+  int *weight = (int *)malloc((count > 0 ? count : 1) * sizeof(int));
+
+  #pragma omp parallel for num_threads(num_threads)
+  for (int t = 0; t < num_threads; t++)
+  {
+    memcpy(from + first[t], lists[t].from, lists[t].count * sizeof(int));
+    memcpy(to + first[t], lists[t].to, lists[t].count * sizeof(int));
+    memcpy(weight + first[t], lists[t].weight, lists[t].count * sizeof(int));
+    free(lists[t].from);
+    free(lists[t].to);
+    free(lists[t].weight);
+  }
+  free(lists);
+  free(first);
+
+  build_graph(graph, num_nodes, count, from, to, weight);
+
+  free(from);
+  free(to);
+  free(weight);
+  return 0;
+}
+
+// Returns the index of edge i -> j in targets/weights, or -1 if absent.
+int find_edge(const Graph *graph, int i, int j)
+{
+  for (int e = graph->offsets[i]; e < graph->offsets[i + 1]; e++)
+  {
+    if (graph->targets[e] == j)
+      return e;
+  }
+  return -1;
+}
+
+#endif
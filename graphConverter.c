@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "graph.h"
+
+// Converts a mapped-*.txt edge list into the binary graph format that
+// load_graph() maps instead of parsing. An optional names file gives the
+// name of node i on line i + 1, as written by dataProcessing.c.
+//
+//   ./graphConverter mapped-new-who.txt mapped-new-who.bin [names.txt]
+
+char **load_names(const char *filename, int num_nodes)
+{
+  FILE *file = fopen(filename, "r");
+  if (file == NULL)
+  {
+    printf("Error opening names file %s.\n", filename);
+    return NULL;
+  }
+
+  char **names = (char **)malloc(num_nodes * sizeof(char *));
+  char *line = NULL;
+  size_t capacity = 0;
+  ssize_t length;
+  int count = 0;
+
+  while (count < num_nodes && (length = getline(&line, &capacity, file)) != -1)
+  {
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+      line[--length] = '\0';
+    names[count++] = strdup(line);
+  }
+  free(line);
+  fclose(file);
+
+  // nodes without a line get an empty name
+  while (count < num_nodes)
+    names[count++] = strdup("");
+
+  return names;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3 || argc > 4)
+  {
+    printf("Usage: %s input.txt output.bin [names.txt]\n", argv[0]);
+    return 1;
+  }
+
+  Graph graph;
+  if (load_graph(argv[1], &graph) != 0)
+    return 1;
+
+  char **names = NULL;
+  if (argc == 4 && (names = load_names(argv[3], graph.num_nodes)) == NULL)
+  {
+    free_graph(&graph);
+    return 1;
+  }
+
+  int status = save_binary_graph(argv[2], &graph, names);
+  if (status == 0)
+    printf("Wrote %s: %d nodes, %d edges%s.\n", argv[2], graph.num_nodes, graph.num_edges, names != NULL ? ", names" : "");
+
+  if (names != NULL)
+  {
+    for (int u = 0; u < graph.num_nodes; u++)
+      free(names[u]);
+    free(names);
+  }
+  free_graph(&graph);
+  return status == 0 ? 0 : 1;
+}
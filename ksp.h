@@ -0,0 +1,56 @@
+#ifndef KSP_H
+#define KSP_H
+
+#include <string.h>
+#include "yen.h"
+#include "eppstein.h"
+#include "cache.h"
+
+typedef enum
+{
+  KSP_YEN,  // Yen's loopless paths, one guided search per spur node
+  KSP_PNC,  // Yen with spur searches cut short by node classification
+  KSP_LAZY  // Eppstein-style walks, which may repeat nodes
+} KspAlgorithm;
+
+KspAlgorithm ksp_algorithm = KSP_YEN;
+
+// Returns 0 and sets the algorithm if name is "yen", "pnc" or "lazy".
+int set_ksp_algorithm(const char *name)
+{
+  if (strcmp(name, "yen") == 0)
+    ksp_algorithm = KSP_YEN;
+  else if (strcmp(name, "pnc") == 0)
+    ksp_algorithm = KSP_PNC;
+  else if (strcmp(name, "lazy") == 0)
+    ksp_algorithm = KSP_LAZY;
+  else
+    return -1;
+
+  // the distributed driver runs spur tasks itself, so the choice is made
+  // where they run
+  spur_node_classification = ksp_algorithm == KSP_PNC;
+  return 0;
+}
+
+// Up to K shortest source -> sink paths with the algorithm chosen by
+// ksp_algorithm, through ws->cache when there is one, see
+// yen_k_shortest_paths(). Returns -1 if the cache has no memory for K paths. Yen and PNC find paths of
+// the same costs and differ only in their spur searches.
+int k_shortest_paths(const Graph *graph, int source, int sink, int K, YenWorkspace *ws, PathCostPair K_paths[])
+{
+  if (ws->cache != NULL)
+  {
+    if (ksp_algorithm != KSP_LAZY)
+      return cached_k_shortest_paths(ws->cache, graph, source, sink, K, ws, K_paths);
+
+    // lazy walks are not cached, and reset the state an entry may hold
+    return_cached_query(ws->cache);
+  }
+
+  if (ksp_algorithm == KSP_LAZY)
+    return lazy_k_shortest_walks(graph, source, sink, K, ws, K_paths);
+  return yen_k_shortest_paths(graph, source, sink, K, ws, K_paths);
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef MASK_H
+#define MASK_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "graph.h"
+
+// Per-search overlay of banned nodes and edges. Dijkstra skips whatever the
+// mask bans, so the graph itself is never modified and can be shared by
+// concurrent searches. Both sets are bitsets, and the set bits are also
+// listed so that clear_mask() costs as much as the bans, not O(V + E).
+typedef struct
+{
+  unsigned long long *node_bits;
+  unsigned long long *edge_bits;
+  int *banned_nodes;
+  int *banned_edges;
+  int num_banned_nodes;
+  int num_banned_edges;
+  int nodes_capacity;
+  int edges_capacity;
+} SearchMask;
+
+void init_mask(SearchMask *mask, const Graph *graph)
+{
+  mask->node_bits = (unsigned long long *)calloc(graph->num_nodes / 64 + 1, sizeof(unsigned long long));
+  mask->edge_bits = (unsigned long long *)calloc(graph->num_edges / 64 + 1, sizeof(unsigned long long));
+  mask->nodes_capacity = 16;
+  mask->edges_capacity = 16;
+  mask->banned_nodes = (int *)malloc(mask->nodes_capacity * sizeof(int));
+  mask->banned_edges = (int *)malloc(mask->edges_capacity * sizeof(int));
+  mask->num_banned_nodes = 0;
+  mask->num_banned_edges = 0;
+}
+
+void free_mask(SearchMask *mask)
+{
+  free(mask->node_bits);
+  free(mask->edge_bits);
+  free(mask->banned_nodes);
+  free(mask->banned_edges);
+  mask->node_bits = NULL;
+  mask->edge_bits = NULL;
+  mask->banned_nodes = NULL;
+  mask->banned_edges = NULL;
+}
+
+int node_banned(const SearchMask *mask, int v)
+{
+  return (mask->node_bits[v >> 6] >> (v & 63)) & 1;
+}
+
+int edge_banned(const SearchMask *mask, int e)
+{
+  return (mask->edge_bits[e >> 6] >> (e & 63)) & 1;
+}
+
+void ban_node(SearchMask *mask, int v)
+{
+  if (node_banned(mask, v))
+    return;
+
+  if (mask->num_banned_nodes == mask->nodes_capacity)
+  {
+    mask->nodes_capacity *= 2;
+    mask->banned_nodes = (int *)realloc(mask->banned_nodes, mask->nodes_capacity * sizeof(int));
+  }
+  mask->banned_nodes[mask->num_banned_nodes++] = v;
+  mask->node_bits[v >> 6] |= 1ULL << (v & 63);
+}
+
+// Bans the edge i -> j, if the graph has one.
+void ban_edge(SearchMask *mask, const Graph *graph, int i, int j)
+{
+  int e = find_edge(graph, i, j);
+  if (e == -1 || edge_banned(mask, e))
+    return;
+
+  if (mask->num_banned_edges == mask->edges_capacity)
+  {
+    mask->edges_capacity *= 2;
+    mask->banned_edges = (int *)realloc(mask->banned_edges, mask->edges_capacity * sizeof(int));
+  }
+  mask->banned_edges[mask->num_banned_edges++] = e;
+  mask->edge_bits[e >> 6] |= 1ULL << (e & 63);
+}
+
+void clear_mask(SearchMask *mask)
+{
+  for (int i = 0; i < mask->num_banned_nodes; i++)
+  {
+    int v = mask->banned_nodes[i];
+    mask->node_bits[v >> 6] &= ~(1ULL << (v & 63));
+  }
+  for (int i = 0; i < mask->num_banned_edges; i++)
+  {
+    int e = mask->banned_edges[i];
+    mask->edge_bits[e >> 6] &= ~(1ULL << (e & 63));
+  }
+  mask->num_banned_nodes = 0;
+  mask->num_banned_edges = 0;
+}
+
+#endif
@@ -1,4 +1,11 @@
 #include "queue.h"
+#include "graph.h"
+#include "dijkstra.h"
+#include "path.h"
+#include "yen.h"
+#include "ksp.h"
+#include "query.h"
+#include "server.h"
 #include <limits.h>
 #include <mpi.h>
 #include <omp.h>
@@ -7,202 +14,780 @@
 #include <unistd.h>
 #include <time.h>
 
-#define INF 100000
-#define MAX_NODES 336
 #define RAND_PAIRS 10
 
-void remove_edge(int i, int j, int **graph) 
+void print_path(int path[], int length, int rank)
 {
-  graph[i][j] = INF;
-  graph[j][i] = INF;
+  printf("|| Path from rank %d: ||\n", rank);
+  for (int i = 0; i < length; i++)
+  {
+    printf("%d", path[i]);
+
+    if (i == length - 1)
+      printf("\n");
+    else
+      printf(" -> ");
+  }
 }
 
-void print_path(int path[], int rank) 
+// Flattens pairs into cost, length, nodes... records for a candidate or
+// batch result message, leaving header ints free at the start for the
+// caller. Returns the buffer and stores its size in ints in count.
+int *pack_paths(PathCostPair pairs[], int num_pairs, PathArena *arena, int header, int *count)
 {
-  printf("|| Path from rank %d: ||\n", rank);
-  for (int i = 0; i < MAX_NODES; i++) 
+  int size = header;
+  for (int i = 0; i < num_pairs; i++)
   {
-    if (path[i] != -1) 
-    {
-      printf("%d", path[i]);
+    size += 2 + arena_path_length(arena, pairs[i].handle);
+  }
 
-      if (i == MAX_NODES - 1 || path[i + 1] == -1)
-        printf("\n");
-      else
-        printf(" -> ");
-    } 
-    else
-      break;
+  int *buffer = (int *)malloc((size > 0 ? size : 1) * sizeof(int));
+  int pos = header;
+  for (int i = 0; i < num_pairs; i++)
+  {
+    int handle = pairs[i].handle;
+    int length = arena_path_length(arena, handle);
+    buffer[pos++] = pairs[i].cost;
+    buffer[pos++] = length;
+    memcpy(buffer + pos, arena_path(arena, handle), length * sizeof(int));
+    pos += length;
   }
+
+  *count = size;
+  return buffer;
 }
 
-void copy_path(int path[], int path_copy[]) 
+#define TAG_RESULT 1
+#define TAG_QUERY 2
+#define TAG_TASKS 3
+
+// Adds packed candidates (see pack_paths()) to pq, dropping paths already
+// in seen.
+void merge_candidates(int buffer[], int count, PathSet *seen, PathArena *arena, PriorityQueue *pq)
 {
-  for (int i = 0; i < MAX_NODES; i++) 
+  int pos = 0;
+  while (pos < count)
   {
-    path_copy[i] = path[i];
+    int candidate_cost = buffer[pos];
+    int candidate_length = buffer[pos + 1];
+    int *candidate_path = buffer + pos + 2;
+    pos += 2 + candidate_length;
+
+    if (candidate_cost == INF)
+      continue;
+
+    int handle = add_unique_path(seen, arena, candidate_path, candidate_length);
+    if (handle != -1)
+    {
+      PathCostPair temp_pair;
+      temp_pair.handle = handle;
+      temp_pair.cost = candidate_cost;
+      insert(pq, temp_pair);
+    }
   }
 }
 
-void save_shortest_path(int source, int sink, int predecessors[], int path[]) 
+// Master side of one Yen iteration: hands the spur tasks out in chunks to
+// whichever worker reports back first and merges the candidates each worker
+// returns with its next request. Chunks shrink as the tasks run out
+// (remaining / 2 workers, at least one task), so the expensive early spur
+// nodes go out first and the stragglers at the end are short. An empty
+// chunk ends the iteration for a worker.
+void dispatch_spur_tasks(int tasks[], int task_count, int num_processes, PathSet *seen, PathArena *arena,
+                         PriorityQueue *pq, double *busy)
 {
-  int index = 0;
-  for (int v = sink; v != source; v = predecessors[v]) {
-    path[index++] = v;
+  int num_workers = num_processes - 1;
+  int remaining = 0;
+  for (int pos = 0; pos < task_count; pos += spur_task_size(tasks + pos))
+  {
+    remaining++;
   }
-  path[index] = source;
 
-  // Reverse the path
-  int temp = 0, start = 0;
-  while (start < index) {
-    temp = path[start];
-    path[start] = path[index];
-    path[index] = temp;
-    start++;
-    index--;
+  int pos = 0;
+  int active_workers = num_workers;
+  while (active_workers > 0)
+  {
+    MPI_Status status;
+    int count;
+    MPI_Probe(MPI_ANY_SOURCE, TAG_RESULT, MPI_COMM_WORLD, &status);
+    MPI_Get_count(&status, MPI_INT, &count);
+
+    int *buffer = (int *)malloc((count > 0 ? count : 1) * sizeof(int));
+    MPI_Recv(buffer, count, MPI_INT, status.MPI_SOURCE, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+    int chunk = remaining / (2 * num_workers);
+    if (chunk < 1)
+      chunk = 1;
+
+    int start = pos;
+    for (int t = 0; t < chunk && pos < task_count; t++)
+    {
+      pos += spur_task_size(tasks + pos);
+      remaining--;
+    }
+    MPI_Send(tasks + start, pos - start, MPI_INT, status.MPI_SOURCE, TAG_TASKS, MPI_COMM_WORLD);
+    if (pos == start)
+      active_workers--;
+
+    double merge_start = MPI_Wtime();
+    merge_candidates(buffer, count, seen, arena, pq);
+    *busy += MPI_Wtime() - merge_start;
+    free(buffer);
   }
 }
 
-int get_path_length(int path[]) {
-  int len = 0;
-  for (int i = 0; i < MAX_NODES; i++) {
-    if (path[i] != -1)
-      len++;
+// Worker side of one Yen iteration: asks the master for spur tasks, runs
+// each chunk as OpenMP tasks and sends the candidates back with the next
+// request, until the master answers with an empty chunk. Only the best
+// limit candidates of a chunk can still become one of the K paths, so the
+// rest are dropped before sending; limit 0 keeps them all.
+void work_spur_tasks(const SinkTree *tree, const Graph *graph, SpurScratch scratch[], int num_threads, PathSet *seen,
+                     PathArena *arena, int limit, double *busy)
+{
+  PriorityQueue pq;
+  initialize(&pq);
+  set_queue_limit(&pq, limit);
+  reset_path_arena(arena);
+  reset_path_set(seen);
+
+  int send_count = 0;
+  int *send_buffer = pack_paths(pq.pairs, 0, arena, 0, &send_count);
+
+  while (1)
+  {
+    MPI_Send(send_buffer, send_count, MPI_INT, 0, TAG_RESULT, MPI_COMM_WORLD);
+    free(send_buffer);
+
+    MPI_Status status;
+    int task_count;
+    MPI_Probe(0, TAG_TASKS, MPI_COMM_WORLD, &status);
+    MPI_Get_count(&status, MPI_INT, &task_count);
+
+    int *tasks = (int *)malloc((task_count > 0 ? task_count : 1) * sizeof(int));
+    MPI_Recv(tasks, task_count, MPI_INT, 0, TAG_TASKS, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    if (task_count == 0)
+    {
+      free(tasks);
+      break;
+    }
+
+    double start = MPI_Wtime();
+    run_spur_tasks(tasks, task_count, tree, graph, scratch, num_threads, seen, arena, &pq);
+    trim_queue(&pq);
+    send_buffer = pack_paths(pq.pairs, pq.size, arena, 0, &send_count);
+    pq.size = 0;
+    *busy += MPI_Wtime() - start;
+    free(tasks);
   }
-  return len;
+
+  free_queue(&pq);
 }
 
-int get_min_vertex(int distances[], int visited[]) 
+// Gathers every rank's statistics on the master and prints them in rank
+// order. Idle time is whatever part of the run was not spent computing:
+// waiting for work, for the master or in communication. queries is only
+// printed when it is not negative.
+void report_stats(int rank, int num_processes, int queries, int searches, double busy, double elapsed)
 {
-  int min = INF, min_index = -1;
+  double local[4] = {queries, searches, busy, elapsed - busy};
+  double *all = NULL;
+  if (rank == 0)
+    all = (double *)malloc(4 * num_processes * sizeof(double));
 
-  for (int vertex = 0; vertex < MAX_NODES; vertex++) {
-    if (visited[vertex] == 0 && distances[vertex] <= min) {
-      min = distances[vertex];
-      min_index = vertex;
+  MPI_Gather(local, 4, MPI_DOUBLE, all, 4, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+  if (rank == 0)
+  {
+    for (int p = 0; p < num_processes; p++)
+    {
+      double *stats = all + 4 * p;
+      printf("RANK : %d  ", p);
+      if (queries >= 0)
+        printf("|| QUERIES: %d  ", (int)stats[0]);
+      printf("|| SPUR SEARCHES: %d  || BUSY: %.3fs  || IDLE: %.3fs (%.0f%%)\n", (int)stats[1], stats[2], stats[3],
+             stats[2] + stats[3] > 0 ? 100 * stats[3] / (stats[2] + stats[3]) : 0.0);
     }
+    free(all);
   }
-  return min_index;
 }
 
-int dijkstra(int source, int sink, int** graph, int shortest_path[]) 
+// Prints the sink tree reuse of all ranks together on the master.
+void report_tree_stats(int rank, SinkTreeCache *trees)
+{
+  long long counts[2] = {trees->hits, trees->misses};
+  MPI_Reduce(rank == 0 ? MPI_IN_PLACE : counts, counts, 2, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (rank == 0)
+    printf("Sink trees: %lld reused, %lld built, room for %d per rank\n", counts[0], counts[1], trees->capacity);
+}
+
+// Batch mode: whole queries are handed out one at a time to whichever worker
+// asks next, so ranks stay busy however uneven the queries are, and each
+// worker runs the spur searches of its query as OpenMP tasks. A worker
+// message is [query index, paths found, cost, length, nodes...] (index -1
+// for its first request), the master answers [query index, source, sink, K]
+// or index -1 when the batch is done. Results are written in query order as
+// soon as all earlier ones have arrived. With a single process the master
+// answers every query itself.
+void run_batch(const char *query_file, const char *output_file, int default_K, int cache_size, const Graph *graph,
+               int rank, int num_processes)
 {
-  int visited[MAX_NODES];
-  int distance[MAX_NODES];
-  int predecessors[MAX_NODES];
+  YenWorkspace ws;
+  init_yen_workspace(&ws, graph);
 
-  for (int i = 0; i < MAX_NODES; i++) 
+  // every process caches the queries it answers
+  ResultCache cache;
+  if (cache_size > 0)
   {
-    distance[i] = INF;
-    visited[i] = 0;
-    shortest_path[i] = -1;
-    predecessors[i] = -1;
+    init_result_cache(&cache, cache_size);
+    ws.cache = &cache;
   }
+  int queries_done = 0;
+  double busy = 0;
+  double start = MPI_Wtime();
 
-  distance[source] = 0;
-
-  for (int i = 0; i < MAX_NODES - 1; i++) 
+  if (rank == 0)
   {
-    int curr_min_vertex = get_min_vertex(distance, visited);
-    visited[curr_min_vertex] = 1;
+    int num_queries = 0;
+    Query *queries = load_queries(query_file, default_K, graph->num_nodes, &num_queries);
+
+    FILE *out = stdout;
+    if (output_file != NULL && (out = fopen(output_file, "w")) == NULL)
+    {
+      fprintf(stderr, "Error opening output file %s.\n", output_file);
+      out = NULL;
+    }
+    if (queries == NULL || out == NULL)
+      MPI_Abort(MPI_COMM_WORLD, 1);
 
-    for (int adj_v = 0; adj_v < MAX_NODES; adj_v++)
+    PathArena batch_arena;
+    init_path_arena(&batch_arena);
+    int max_K = 1;
+    for (int q = 0; q < num_queries; q++)
     {
-      //dist[curr_min_vertex] != INF, if node is unreachable, its dist is INF
-      if (visited[adj_v] != 1 && graph[curr_min_vertex][adj_v] &&
-        distance[curr_min_vertex] != INF &&
-        distance[curr_min_vertex] + graph[curr_min_vertex][adj_v] < distance[adj_v])
+      if (queries[q].K > max_K)
+        max_K = queries[q].K;
+    }
+    PathCostPair *K_paths = (PathCostPair *)malloc(max_K * sizeof(PathCostPair));
+
+    if (num_processes == 1)
+    {
+      for (int q = 0; q < num_queries; q++)
+      {
+        int found = k_shortest_paths(graph, queries[q].source, queries[q].sink, queries[q].K, &ws, K_paths);
+        if (found < 0)
+        {
+          fprintf(stderr, "Out of memory for the paths of query %d.\n", q);
+          MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        write_query_paths(out, q, &queries[q], K_paths, found, &ws.arena);
+        queries_done++;
+      }
+      busy = MPI_Wtime() - start;
+    }
+    else
+    {
+      // results that arrived before an earlier query finished
+      int **pending = (int **)calloc(num_queries > 0 ? num_queries : 1, sizeof(int *));
+      int next_query = 0, next_to_write = 0;
+      int active_workers = num_processes - 1;
+
+      while (active_workers > 0)
+      {
+        MPI_Status status;
+        int count;
+        MPI_Probe(MPI_ANY_SOURCE, TAG_RESULT, MPI_COMM_WORLD, &status);
+        MPI_Get_count(&status, MPI_INT, &count);
+
+        int *message = (int *)malloc(count * sizeof(int));
+        MPI_Recv(message, count, MPI_INT, status.MPI_SOURCE, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+        if (message[0] >= 0)
+          pending[message[0]] = message;
+        else
+          free(message);
+
+        int reply[4] = {-1, 0, 0, 0};
+        if (next_query < num_queries)
+        {
+          reply[0] = next_query;
+          reply[1] = queries[next_query].source;
+          reply[2] = queries[next_query].sink;
+          reply[3] = queries[next_query].K;
+          next_query++;
+        }
+        else
+        {
+          active_workers--;
+        }
+        MPI_Send(reply, 4, MPI_INT, status.MPI_SOURCE, TAG_QUERY, MPI_COMM_WORLD);
+
+        while (next_to_write < num_queries && pending[next_to_write] != NULL)
         {
-          distance[adj_v] = distance[curr_min_vertex] + graph[curr_min_vertex][adj_v];
-          predecessors[adj_v] = curr_min_vertex;
+          int *result = pending[next_to_write];
+          int found = result[1];
+          int pos = 2;
+
+          reset_path_arena(&batch_arena);
+          for (int i = 0; i < found; i++)
+          {
+            K_paths[i].cost = result[pos];
+            K_paths[i].handle = add_path(&batch_arena, result + pos + 2, result[pos + 1]);
+            pos += 2 + result[pos + 1];
+          }
+          write_query_paths(out, next_to_write, &queries[next_to_write], K_paths, found, &batch_arena);
+
+          free(result);
+          pending[next_to_write] = NULL;
+          next_to_write++;
         }
-    }     
+      }
+      free(pending);
+    }
+
+    if (out != stdout)
+      fclose(out);
+    free(K_paths);
+    free_path_arena(&batch_arena);
+    free(queries);
+    printf("\nExecution time for %d queries: %f\n\n", num_queries, MPI_Wtime() - start);
   }
+  else
+  {
+    int K_capacity = default_K;
+    PathCostPair *K_paths = (PathCostPair *)malloc(K_capacity * sizeof(PathCostPair));
+
+    int request[2] = {-1, 0};
+    MPI_Send(request, 2, MPI_INT, 0, TAG_RESULT, MPI_COMM_WORLD);
 
-  if(distance[sink] != INF)
+    while (1)
+    {
+      int query[4];
+      MPI_Recv(query, 4, MPI_INT, 0, TAG_QUERY, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+      if (query[0] == -1)
+        break;
+
+      if (query[3] > K_capacity)
+      {
+        K_capacity = query[3];
+        K_paths = (PathCostPair *)realloc(K_paths, K_capacity * sizeof(PathCostPair));
+      }
+
+      double query_start = MPI_Wtime();
+      int found = k_shortest_paths(graph, query[1], query[2], query[3], &ws, K_paths);
+      if (found < 0)
+      {
+        fprintf(stderr, "Out of memory for the paths of query %d.\n", query[0]);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      busy += MPI_Wtime() - query_start;
+      queries_done++;
+
+      int count;
+      int *result = pack_paths(K_paths, found, &ws.arena, 2, &count);
+      result[0] = query[0];
+      result[1] = found;
+      MPI_Send(result, count, MPI_INT, 0, TAG_RESULT, MPI_COMM_WORLD);
+      free(result);
+    }
+    free(K_paths);
+  }
+
+  report_stats(rank, num_processes, queries_done, get_work_done(&ws), busy, MPI_Wtime() - start);
+  report_tree_stats(rank, &ws.trees);
+
+  if (cache_size > 0)
+  {
+    long long counts[3] = {cache.hits, cache.extensions, cache.misses};
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : counts, counts, 3, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (rank == 0)
+      printf("Cache: %lld hits, %lld extensions, %lld misses\n", counts[0], counts[1], counts[2]);
+    free_result_cache(&cache);
+  }
+  free_yen_workspace(&ws);
+}
+
+// Everything a process keeps across the queries of the distributed mode.
+typedef struct
+{
+  SpurScratch *scratch;
+  int num_threads;
+  // arena holds the paths of the current query on the master, local_arena
+  // the candidates a process found in the current k
+  PathArena arena, local_arena;
+  PathSet seen, local_seen; // the paths of each arena, to reject duplicates
+  PriorityQueue pq;
+  SinkTreeCache trees;
+  const SinkTree *tree;     // guides every spur search of the current query
+  YenWorkspace lazy_ws;     // lazy walks are not split into spur tasks
+  int *path;
+} DistributedYen;
+
+void init_distributed_yen(DistributedYen *dy, const Graph *graph, int rank)
+{
+  dy->num_threads = omp_get_max_threads();
+  dy->scratch = (SpurScratch *)malloc(dy->num_threads * sizeof(SpurScratch));
+  for (int t = 0; t < dy->num_threads; t++)
+  {
+    init_spur_scratch(&dy->scratch[t], graph);
+  }
+  init_path_arena(&dy->arena);
+  init_path_arena(&dy->local_arena);
+  init_path_set(&dy->seen);
+  init_path_set(&dy->local_seen);
+  initialize(&dy->pq);
+  init_sink_tree_cache(&dy->trees, graph);
+  dy->tree = NULL;
+  if (ksp_algorithm == KSP_LAZY && rank == 0)
+    init_yen_workspace(&dy->lazy_ws, graph);
+  dy->path = (int *)malloc(graph->num_nodes * sizeof(int));
+}
+
+void free_distributed_yen(DistributedYen *dy, int rank)
+{
+  for (int t = 0; t < dy->num_threads; t++)
   {
-    save_shortest_path(source, sink, predecessors, shortest_path);
+    free_spur_scratch(&dy->scratch[t]);
   }
+  free(dy->scratch);
+  free_path_arena(&dy->arena);
+  free_path_arena(&dy->local_arena);
+  free_path_set(&dy->seen);
+  free_path_set(&dy->local_seen);
+  free_queue(&dy->pq);
+  free_sink_tree_cache(&dy->trees);
+  if (ksp_algorithm == KSP_LAZY && rank == 0)
+    free_yen_workspace(&dy->lazy_ws);
+  free(dy->path);
+}
 
-  return distance[sink];
+// report_tree_stats() for a distributed run, which on the master includes
+// the trees of lazy walks, built in their own workspace.
+void report_distributed_tree_stats(int rank, DistributedYen *dy)
+{
+  SinkTreeCache trees = dy->trees;
+  if (ksp_algorithm == KSP_LAZY && rank == 0)
+  {
+    trees.hits += dy->lazy_ws.trees.hits;
+    trees.misses += dy->lazy_ws.trees.misses;
+  }
+  report_tree_stats(rank, &trees);
 }
 
-int check_same_path(int path1[], int path2[]) 
+int distributed_work_done(DistributedYen *dy)
 {
-  for (int i = 0; i < MAX_NODES; i++) 
+  int work_done = 0;
+  for (int t = 0; t < dy->num_threads; t++)
   {
-    if (path1[i] != path2[i])
-      return 0;
+    work_done += dy->scratch[t].work_done;
   }
-  return 1;
+  return work_done;
 }
 
-void extract_sub_path(int path[], int sub_path[], int curr_node) 
+// One query answered by every process together, each Yen iteration's spur
+// tasks pulled by the workers (see dispatch_spur_tasks()). Every rank must
+// call it with the same source, sink, K and found. found is 0 for a new
+// query; otherwise the master's K_paths holds the first found paths and dy
+// the rest of an earlier query for fewer paths (see cache.h), which was run
+// with keep_candidates set, so that every candidate is still there. On the
+// master it fills K_paths with handles into dy->arena and returns how many
+// paths were found; other ranks return 0 and may pass NULL.
+int distributed_k_shortest_paths(DistributedYen *dy, int source, int sink, int K, const Graph *graph, int rank,
+                                 int num_processes, PathCostPair K_paths[], int found, int keep_candidates,
+                                 double *busy)
 {
-  int curr_node_idx = -1;
+  int first = found;
+  if (found == 0)
+    reset_path_arena(&dy->arena);
 
-  for (int i = 0; i < MAX_NODES; i++) 
+  if (ksp_algorithm == KSP_LAZY)
   {
-    if (path[i] == curr_node) 
+    if (rank == 0)
     {
-      sub_path[i] = path[i];
-      curr_node_idx = i;
+      double lazy_start = MPI_Wtime();
+      found = k_shortest_paths(graph, source, sink, K, &dy->lazy_ws, K_paths);
+      for (int i = 0; i < found; i++)
+      {
+        int handle = K_paths[i].handle;
+        K_paths[i].handle = add_path(&dy->arena, arena_path(&dy->lazy_ws.arena, handle),
+                                     arena_path_length(&dy->lazy_ws.arena, handle));
+      }
+      *busy += MPI_Wtime() - lazy_start;
     }
+    return found;
+  }
+
+  double tree_start = MPI_Wtime();
+  dy->tree = sink_tree(&dy->trees, sink, graph);
+  *busy += MPI_Wtime() - tree_start;
+
+  if (rank == 0 && first == 0) // calculate first shortest path
+  {
+    dy->pq.size = 0;
+    dy->pq.limit = 0;
+    reset_path_set(&dy->seen);
 
-    if (curr_node_idx == -1) // means we have not reached curr node yet
-      sub_path[i] = path[i];
+    int length;
+    double first_start = MPI_Wtime();
+    int cost = dijkstra(source, sink, graph, NULL, dy->tree, &dy->scratch[0].search, dy->path, &length);
+    *busy += MPI_Wtime() - first_start;
 
-    else if (curr_node_idx != -1 && i > curr_node_idx) // means we have reached curr node
-      sub_path[i] = -1;
+    // add to K shortest path and cost
+    if (cost != INF)
+    {
+      K_paths[0].handle = add_unique_path(&dy->seen, &dy->arena, dy->path, length);
+      K_paths[0].cost = cost;
+      found = 1;
+    }
   }
-}
 
-void concat_path(int root_path[], int sub_path[], int concat_path[]) 
-{
-  int idx = 0;
-  for (int i = 0; i < MAX_NODES; i++) 
+  for (int k = first > 1 ? first : 1; k < K; k++)
   {
-    if (root_path[i] != -1) {
-      concat_path[i] = root_path[i];
-    } 
-    else 
+    int len;
+    int *curr_path = NULL;
+    if (rank == 0)
+    {
+      // len 0 tells every rank that fewer than K paths exist
+      len = (found == k) ? arena_path_length(&dy->arena, K_paths[k - 1].handle) : 0;
+      if (len > 0)
+      {
+        // copied out of the arena, which may move while candidates are added
+        curr_path = (int *)malloc(len * sizeof(int));
+        memcpy(curr_path, arena_path(&dy->arena, K_paths[k - 1].handle), len * sizeof(int));
+
+        // only the best K - k candidates can still become one of the K paths
+        set_queue_limit(&dy->pq, keep_candidates ? 0 : K - k);
+      }
+    }
+
+    MPI_Bcast(&len, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (len == 0)
+      break;
+
+    if (rank == 0)
+    {
+      // the master turns every spur node of the previous path into a task;
+      // other processes pull them in chunks, a lone process runs them all
+      double build_start = MPI_Wtime();
+      int task_count;
+      int *tasks = build_spur_tasks(curr_path, len, K_paths, k, &dy->arena, graph, &task_count);
+      if (tasks == NULL)
+      {
+        fprintf(stderr, "Out of memory for the spur tasks of path %d.\n", k + 1);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      *busy += MPI_Wtime() - build_start;
+
+      if (num_processes == 1)
+      {
+        double run_start = MPI_Wtime();
+        run_spur_tasks(tasks, task_count, dy->tree, graph, dy->scratch, dy->num_threads, &dy->seen, &dy->arena, &dy->pq);
+        *busy += MPI_Wtime() - run_start;
+      }
+      else
+      {
+        dispatch_spur_tasks(tasks, task_count, num_processes, &dy->seen, &dy->arena, &dy->pq, busy);
+      }
+      free(tasks);
+      free(curr_path);
+
+      // add min shortest path to K_paths
+      if (dy->pq.size > 0)
+      {
+        K_paths[k] = extractMin(&dy->pq);
+        found++;
+      }
+    }
+    else
     {
-      concat_path[i] = sub_path[++idx];
+      work_spur_tasks(dy->tree, graph, dy->scratch, dy->num_threads, &dy->local_seen, &dy->local_arena,
+                      keep_candidates ? 0 : K - k, busy);
     }
   }
+
+  return found;
 }
 
-void copy_graph(int **graph, int **copy_graph) 
+// Server mode: the master reads queries from clients of a local socket (see
+// server.h) and broadcasts each to every rank, which then answer it together
+// as in the distributed mode, so a query costs only its own search.
+void run_server(const char *socket_path, int default_K, int max_K, int cache_size, const Graph *graph, int rank,
+                int num_processes)
 {
-  for (int i = 0; i < MAX_NODES; i++) 
+  DistributedYen dy;
+  init_distributed_yen(&dy, graph, rank);
+
+  // the master keeps the results, lazy walks are not cached
+  ResultCache cache;
+  int use_cache = cache_size > 0 && ksp_algorithm != KSP_LAZY;
+  if (use_cache && rank == 0)
+    init_result_cache(&cache, cache_size);
+
+  int queries_done = 0;
+  double busy = 0;
+  double start = MPI_Wtime();
+
+  QueryServer server;
+  int K_capacity = default_K;
+  PathCostPair *K_paths = NULL;
+  if (rank == 0)
   {
-    for (int j = 0; j < MAX_NODES; j++) 
+    if (open_query_server(&server, socket_path) != 0)
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    if (use_cache)
+      server.cache = &cache;
+    server.max_K = max_K;
+    printf("Listening on %s\n", socket_path);
+    fflush(stdout);
+    K_paths = (PathCostPair *)malloc(K_capacity * sizeof(PathCostPair));
+  }
+
+  while (1)
+  {
+    // source, sink, K and paths already known, source -1 once a client asks
+    // the server to shut down
+    Query query;
+    int message[4] = {-1, 0, 0, 0};
+    CachedQuery *entry = NULL;
+    while (rank == 0 && next_query(&server, default_K, graph->num_nodes, &query))
     {
-      copy_graph[i][j] = graph[i][j];
+      if (use_cache)
+      {
+        // answered from the cache if it holds enough paths, otherwise
+        // resumed from the paths it holds
+        entry = check_out_query(&cache, query.source, query.sink, query.K, &dy.arena, &dy.seen, &dy.pq);
+        if (entry == NULL)
+        {
+          reject_query(&server);
+          continue;
+        }
+        count_cached_query(&cache, entry, query.K);
+        if (cached_query_complete(entry, query.K))
+        {
+          answer_query(&server, &query, entry->paths, entry->found < query.K ? entry->found : query.K, &dy.arena);
+          queries_done++;
+          continue;
+        }
+        message[3] = entry->found;
+      }
+      else if (query.K > K_capacity)
+      {
+        PathCostPair *grown = (PathCostPair *)realloc(K_paths, query.K * sizeof(PathCostPair));
+        if (grown == NULL)
+        {
+          reject_query(&server);
+          continue;
+        }
+        K_paths = grown;
+        K_capacity = query.K;
+      }
+
+      message[0] = query.source;
+      message[1] = query.sink;
+      message[2] = query.K;
+      break;
+    }
+    MPI_Bcast(message, 4, MPI_INT, 0, MPI_COMM_WORLD);
+    if (message[0] == -1)
+      break;
+
+    int found = distributed_k_shortest_paths(&dy, message[0], message[1], message[2], graph, rank, num_processes,
+                                             entry != NULL ? entry->paths : K_paths, message[3], use_cache, &busy);
+    if (rank == 0)
+    {
+      if (entry != NULL)
+      {
+        entry->found = found;
+        entry->K = query.K;
+        answer_query(&server, &query, entry->paths, found, &dy.arena);
+      }
+      else
+      {
+        answer_query(&server, &query, K_paths, found, &dy.arena);
+      }
+    }
+    queries_done++;
+  }
+
+  if (rank == 0)
+  {
+    close_query_server(&server);
+    free(K_paths);
+    printf("Served %d queries\n", queries_done);
+    if (use_cache)
+    {
+      print_cache_stats(stdout, &cache);
+      return_cached_query(&cache);
+      free_result_cache(&cache);
     }
   }
+
+  report_stats(rank, num_processes, queries_done, distributed_work_done(&dy), busy, MPI_Wtime() - start);
+  report_distributed_tree_stats(rank, &dy);
+  free_distributed_yen(&dy, rank);
 }
 
-int path_exists(int path[], int** K_paths, int K, PriorityQueue pq) 
+// MPI_Bcast of count ints, in pieces that fit the int count of MPI.
+void bcast_ints(int buffer[], size_t count, int root, MPI_Comm comm)
 {
-  // Check in priority queue
-  for (int i = 0; i < pq.size; i++) 
+  const size_t piece = 1 << 28;
+  for (size_t pos = 0; pos < count; pos += piece)
   {
-    if (check_same_path(path, pq.pairs[i].path))
-      return 1; // Path exists, discard it
+    size_t size = count - pos < piece ? count - pos : piece;
+    MPI_Bcast(buffer + pos, (int)size, MPI_INT, root, comm);
   }
+}
 
-  // Check in K_paths matrix
-  for (int i = 0; i < K; i++) 
+// Places one copy of the graph per host in an MPI-3 shared-memory window,
+// so memory per host does not grow with the number of ranks on it. The
+// first rank of each host allocates the window and receives the graph from
+// rank 0; the other ranks of the host map the same memory. Free the window
+// instead of the graph.
+void share_graph(Graph *graph, int header[], int rank, MPI_Win *win)
+{
+  MPI_Comm node_comm, leader_comm;
+  int node_rank;
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+  MPI_Comm_rank(node_comm, &node_rank);
+  MPI_Comm_split(MPI_COMM_WORLD, node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &leader_comm);
+
+  size_t size = graph_data_size(header[0], header[1]);
+  int *data;
+  MPI_Aint window_size = node_rank == 0 ? (MPI_Aint)(size * sizeof(int)) : 0;
+  MPI_Win_allocate_shared(window_size, sizeof(int), MPI_INFO_NULL, node_comm, &data, win);
+
+  if (node_rank == 0)
   {
-    if (check_same_path(path, K_paths[i]))
-      return 1; // Path exists, discard it
+    // rank 0 has the loaded graph and is the first rank of its host
+    if (rank == 0)
+    {
+      memcpy(data, graph->data, size * sizeof(int));
+      free_graph(graph);
+    }
+    bcast_ints(data, size, 0, leader_comm);
+    MPI_Comm_free(&leader_comm);
   }
+  else
+  {
+    MPI_Aint query_size;
+    int disp_unit;
+    MPI_Win_shared_query(*win, 0, &query_size, &disp_unit, &data);
+  }
+  MPI_Barrier(node_comm); // the graph is in place before anyone reads it
+  MPI_Comm_free(&node_comm);
+
+  attach_graph(graph, header[0], header[1], data);
+  graph->max_weight = header[2];
+}
 
-  return 0; // Path does not exist
+void release_graph(Graph *graph, MPI_Win *win)
+{
+  if (*win != MPI_WIN_NULL)
+    MPI_Win_free(win);
+  else
+    free_graph(graph);
 }
 
-int main(int argc, char *argv[]) 
+int main(int argc, char *argv[])
 {
   srand(time(NULL));
   int rank, num_processes;
@@ -211,79 +796,164 @@ int main(int argc, char *argv[])
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_size(MPI_COMM_WORLD, &num_processes);
 
-  int **graph = (int **)malloc(MAX_NODES * sizeof(int *));
-  for (int i = 0; i < MAX_NODES; i++) 
+  const char *filename = "mapped-new-who.txt";
+  const char *query_file = NULL;
+  const char *output_file = NULL;
+  const char *socket_path = NULL;
+  int K = 10;
+  int server_max_K = DEFAULT_SERVER_MAX_K;
+  int cache_size = 0;
+  int shared_graph = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "a:c:e:f:k:K:l:m:q:o:s")) != -1)
   {
-    graph[i] = (int *)malloc(MAX_NODES * sizeof(int));
-    for (int j = 0; j < MAX_NODES; j++) 
+    switch (opt)
     {
-      graph[i][j] = 0;
+      case 'a':
+        if (set_ksp_algorithm(optarg) != 0)
+        {
+          if (rank == 0)
+            fprintf(stderr, "Unknown algorithm %s (use yen, pnc or lazy).\n", optarg);
+          MPI_Finalize();
+          return 1;
+        }
+        break;
+      case 'c':
+        cache_size = atoi(optarg);
+        break;
+      case 'e':
+        if (set_dijkstra_engine(optarg) != 0)
+        {
+          if (rank == 0)
+            fprintf(stderr, "Unknown Dijkstra engine %s (use scan, heap, bucket or bidir).\n", optarg);
+          MPI_Finalize();
+          return 1;
+        }
+        break;
+      case 'f':
+        filename = optarg;
+        break;
+      case 'k':
+        K = atoi(optarg);
+        if (K < 1)
+        {
+          if (rank == 0)
+            fprintf(stderr, "K must be at least 1.\n");
+          MPI_Finalize();
+          return 1;
+        }
+        break;
+      case 'K':
+        server_max_K = atoi(optarg);
+        if (server_max_K < 1)
+        {
+          if (rank == 0)
+            fprintf(stderr, "The largest K must be at least 1.\n");
+          MPI_Finalize();
+          return 1;
+        }
+        break;
+      case 'l':
+        socket_path = optarg;
+        break;
+      case 'm':
+        if (set_tree_cache_budget(optarg) != 0)
+        {
+          if (rank == 0)
+            fprintf(stderr, "The tree cache budget must be a positive number of megabytes.\n");
+          MPI_Finalize();
+          return 1;
+        }
+        break;
+      case 'q':
+        query_file = optarg;
+        break;
+      case 'o':
+        output_file = optarg;
+        break;
+      case 's':
+        shared_graph = 1;
+        break;
+      default:
+        if (rank == 0)
+          fprintf(stderr, "Usage: %s [-a yen|pnc|lazy] [-c cache_entries] [-e scan|heap|bucket|bidir] [-f graph_file] [-k K] [-m tree_megabytes] [-q query_file [-o output_file] | -l socket [-K max_K]] [-s]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
     }
   }
 
-  int** org_graph;
+  Graph graph;
+  int header[3]; // nodes, edges, max weight
+  MPI_Win graph_win = MPI_WIN_NULL;
 
-  if(rank==0)
+  if (is_binary_graph(filename))
   {
-    org_graph = (int **)malloc(MAX_NODES * sizeof(int *));
-    for (int i = 0; i < MAX_NODES; i++) 
+    // every rank maps the file itself: the ranks of a host share its pages
+    // and nothing is sent
+    if (load_graph(filename, &graph) != 0)
     {
-      org_graph[i] = (int *)malloc(MAX_NODES * sizeof(int));
-      for (int j = 0; j < MAX_NODES; j++) 
-      {
-          org_graph[i][j] = 0;
-      }
+      MPI_Abort(MPI_COMM_WORLD, 1);
     }
-    
-    FILE *file = fopen("mapped-new-who.txt", "r"); 
-    if (file == NULL) 
+  }
+  else
+  {
+    if(rank==0)
     {
-      fprintf(stderr, "Error opening file.\n");
-      return 1; // Exit if file opening fails
-    }
+      if (load_graph(filename, &graph) != 0)
+      {
+        MPI_Abort(MPI_COMM_WORLD, 1); // Exit if file opening fails
+      }
 
-    // Skip the first two lines
-    char line[100];
-    void* ptr = fgets(line, sizeof(line), file); // Skip the first line
-    ptr = fgets(line, sizeof(line), file); // Skip the second line
+      header[0] = graph.num_nodes;
+      header[1] = graph.num_edges;
+      header[2] = graph.max_weight;
+    }
 
+    MPI_Bcast(header, 3, MPI_INT, 0, MPI_COMM_WORLD);
 
-    // Read data from the file and populate the graph
-    int from_node, to_node, weight;
-    while (fscanf(file, "%d %d %d", &from_node, &to_node, &weight) == 3) 
+    // the graph is sent once, spur tasks only carry the edges they remove
+    if (shared_graph)
+    {
+      share_graph(&graph, header, rank, &graph_win);
+    }
+    else
     {
-      graph[from_node][to_node] = weight;
+      if(rank!=0)
+      {
+        allocate_graph(&graph, header[0], header[1]);
+        graph.max_weight = header[2];
+      }
+      bcast_ints(graph.data, graph_data_size(header[0], header[1]), 0, MPI_COMM_WORLD);
     }
-    copy_graph(graph, org_graph);
-    fclose(file);
   }
+  int num_nodes = graph.num_nodes;
 
-  for(int i=0; i<MAX_NODES; i++)
+  if (socket_path != NULL)
   {
-    MPI_Bcast(graph[i], MAX_NODES, MPI_INT, 0, MPI_COMM_WORLD);
+    run_server(socket_path, K, server_max_K, cache_size, &graph, rank, num_processes);
+    release_graph(&graph, &graph_win);
+    MPI_Finalize();
+    return 0;
   }
 
-  // Initializations
-  int K = 10;
-
-  int **K_paths = (int **)malloc(K * sizeof(int *));
-  for (int i = 0; i < K; i++) 
+  if (query_file != NULL)
   {
-    K_paths[i] = (int *)malloc(MAX_NODES * sizeof(int));
+    run_batch(query_file, output_file, K, cache_size, &graph, rank, num_processes);
+    release_graph(&graph, &graph_win);
+    MPI_Finalize();
+    return 0;
   }
-  
-  int *K_costs = (int *)malloc(K * sizeof(int));
 
-  PriorityQueue all_pqs[num_processes];
-  #pragma omp parallel for
-  for (int i = 0; i < num_processes; i++) 
-  {
-    initialize(&all_pqs[i]);
-  }
+  DistributedYen dy;
+  init_distributed_yen(&dy, &graph, rank);
 
-  int work_done = 0;
-  int work_counter = 0;
+  // the K paths of every pair, kept for printing
+  PathArena results;
+  init_path_arena(&results);
 
+  PathCostPair *all_K_paths[RAND_PAIRS];
+  int all_found[RAND_PAIRS];
   int all_sources[RAND_PAIRS];
   int all_sinks[RAND_PAIRS];
 
@@ -291,218 +961,86 @@ int main(int argc, char *argv[])
   double cpu_time, total_cpu_time=0;
 
   start = clock();
+  double wall_start = MPI_Wtime();
+  double busy = 0;
 
   for(int rand_pair=0; rand_pair<RAND_PAIRS; rand_pair++)
   {
     int source, sink;
-    
+    PathCostPair *K_paths = NULL;
+
     if(rank==0)
     {
-      source = rand() % MAX_NODES;
-      sink = rand() % MAX_NODES;
+      source = rand() % num_nodes;
+      sink = rand() % num_nodes;
 
       all_sources[rand_pair] = source;
       all_sinks[rand_pair] = sink;
+      K_paths = (PathCostPair *)malloc(K * sizeof(PathCostPair));
     }
 
     MPI_Bcast(&source, 1, MPI_INT, 0, MPI_COMM_WORLD);
     MPI_Bcast(&sink, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
-    // initialize the local Priority Queue to store paths within each process
-    PriorityQueue local_pq;
-    initialize(&local_pq);
+    int found = distributed_k_shortest_paths(&dy, source, sink, K, &graph, rank, num_processes, K_paths, 0, 0, &busy);
 
-    // initialize the main Priority Queue to store paths from processes
-    PriorityQueue pq;
-    initialize(&pq);
-
-    int path[MAX_NODES];
-    int cost = 0;
-
-    //reset for next random pair
-    work_done = 0;
-    work_counter = 0;
-
-    if (rank == 0) // calculate first shortest path
-    {
-      cost = dijkstra(source, sink, graph, path);
-      K_costs[0] = cost;
-
-      // add to K shortest path and cost
-      copy_path(path, K_paths[0]);
-    }
-    
-    for (int k = 1; k < K; k++) 
+    if (rank == 0)
     {
-      int len;
-      int curr_path[MAX_NODES];
-      if (rank == 0) 
-      {
-        copy_path(K_paths[k - 1], curr_path);
-        len = get_path_length(curr_path);
-        omp_set_num_threads(len - 1);
-      }
-
-      MPI_Bcast(&len, 1, MPI_INT, 0, MPI_COMM_WORLD);
-
-      for (int i = 0; i < len - 1; i++) 
-      {
-        // declare variables for all processes
-        int ri[MAX_NODES];
-        int curr_node, src_to_curr_cost;
-
-        // initialize variables by master only
-        if (rank == 0) 
-        {
-          curr_node = curr_path[i];
-          src_to_curr_cost = dijkstra(source, curr_node, org_graph, path);
-          extract_sub_path(curr_path, ri, curr_node);
-        }
-
-        // broadcast neccessary data to processes 
-        MPI_Bcast(&curr_node, 1, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Bcast(&src_to_curr_cost, 1, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Bcast(&ri, MAX_NODES, MPI_INT, 0, MPI_COMM_WORLD);
-
-        if (rank == 0) 
-        {
-          #pragma omp parallel for
-          for (int j = 0; j <= k - 1; j++) 
-          {
-            int jth_path[MAX_NODES];
-            copy_path(K_paths[j], jth_path);
-            int rj[MAX_NODES];
-            extract_sub_path(jth_path, rj, curr_node);
-
-            if (check_same_path(ri, rj)) 
-            {
-              int next_node = jth_path[i + 1];
-              remove_edge(curr_node, next_node, graph);
-            }
-          }
-        }
-
-        int process;
-        if (rank == 0) 
-        {
-          process = (work_counter % (num_processes - 1)) + 1;
-          work_counter++;
-        }
-
-        MPI_Bcast(&process, 1, MPI_INT, 0, MPI_COMM_WORLD);
-        for(int i=0; i<MAX_NODES; i++)
-        {
-          MPI_Bcast(graph[i], MAX_NODES, MPI_INT, 0, MPI_COMM_WORLD);
-        }
-
-        int si[MAX_NODES];
-        PathCostPair pair;
-        int Cost;
-
-        if (rank == process) 
-        {
-          Cost = dijkstra(curr_node, sink, graph, si);
-          work_done++;
-
-          if (Cost != INF) 
-          {
-            concat_path(ri, si, pair.path);
-            pair.cost = Cost + src_to_curr_cost;
-
-            if (!path_exists(pair.path, K_paths, K, pq))
-              insert(&local_pq, pair);
-          }
-        }
-      }
-
-      MPI_Gather(&local_pq, sizeof(PriorityQueue), MPI_BYTE, all_pqs, sizeof(PriorityQueue), MPI_BYTE, 0, MPI_COMM_WORLD);
-
-      if (rank == 0) 
+      for (int i = 0; i < found; i++)
       {
-        omp_set_num_threads(num_processes);
-        // gather all min pqs for current iteration
-        #pragma omp parallel for 
-        for (int pair = 0; pair < num_processes; pair++) 
-        {
-          while (all_pqs[pair].size > 0) 
-          {
-            PathCostPair temp_pair = extractMin(&all_pqs[pair]);
-            if (temp_pair.cost != INF && !path_exists(temp_pair.path, K_paths, K, pq)) 
-            {
-              insert(&pq, temp_pair);
-            }
-          }
-        }
+        int handle = K_paths[i].handle;
+        K_paths[i].handle = add_path(&results, arena_path(&dy.arena, handle), arena_path_length(&dy.arena, handle));
       }
 
-      if (rank == 0) 
-      {
-         copy_graph(org_graph, graph);
-        // add min shortest path to K_paths
-        PathCostPair minPair;
-        if (pq.size > 0) 
-        {
-          minPair = extractMin(&pq);
-        }
-
-        // copy minPair.path and minPair.cost
-        copy_path(minPair.path, K_paths[k]);
-        K_costs[k] = minPair.cost;
-      }
+      all_K_paths[rand_pair] = K_paths;
+      all_found[rand_pair] = found;
     }
   }
-  
+
   end = clock();
   cpu_time = ((double) (end - start)) / CLOCKS_PER_SEC;
-  
+  double elapsed = MPI_Wtime() - wall_start;
+
   MPI_Reduce(&cpu_time, &total_cpu_time, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
 
   MPI_Barrier(MPI_COMM_WORLD); // for printing
-  if (rank == 0) 
+  if (rank == 0)
   {
     for(int rp=0; rp<RAND_PAIRS; rp++)
     {
       printf("\n-----------------------------------------------------------");
       printf("\nSource: %d, Sink: %d\n", all_sources[rp], all_sinks[rp]);
       printf("-----------------------------------------------------------\n");
-      for (int i = 0; i < K; i++) 
+      if (all_found[rp] == 0)
+        printf("\nNo path found\n");
+
+      for (int i = 0; i < all_found[rp]; i++)
       {
         printf("\nk = %d\n", i + 1);
-        print_path(K_paths[i], 0);
-        printf("COST: %d\n", K_costs[i]);
+        int handle = all_K_paths[rp][i].handle;
+        print_path(arena_path(&results, handle), arena_path_length(&results, handle), 0);
+        printf("COST: %d\n", all_K_paths[rp][i].cost);
       }
     }
     printf("\nExecution time for parallel code: %f\n\n", (total_cpu_time/num_processes)/K);
   }
 
-  MPI_Barrier(MPI_COMM_WORLD); // for printing
-  if (rank != 0)
-    printf("RANK : %d  || WORK DONE: %d\n", rank, work_done);
+  report_stats(rank, num_processes, -1, distributed_work_done(&dy), busy, elapsed);
+  report_distributed_tree_stats(rank, &dy);
 
   // free memory
-  for (int i = 0; i < MAX_NODES; i++) 
-  {
-    free(graph[i]);
-  }
-  free(graph);
-  
+  release_graph(&graph, &graph_win);
+  free_distributed_yen(&dy, rank);
+
   if(rank==0)
   {
-    for (int i = 0; i < MAX_NODES; i++) 
+    for (int rp = 0; rp < RAND_PAIRS; rp++)
     {
-      free(org_graph[i]);
+      free(all_K_paths[rp]);
     }
-    free(org_graph);
   }
+  free_path_arena(&results);
 
-  for (int i = 0; i < K; i++) 
-  {
-    free(K_paths[i]);
-  }
-  free(K_paths);
-
-  free(K_costs);
-  
   MPI_Finalize();
   return 0;
-}
\ No newline at end of file
+}
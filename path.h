@@ -0,0 +1,210 @@
+#ifndef PATH_H
+#define PATH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Paths are plain node arrays with an explicit length, so storage follows
+// the number of hops instead of the number of nodes in the graph.
+
+// Append-only store for the paths of one query. Every path gets an int
+// handle, nodes of all paths live back to back in one growable buffer and
+// resetting the arena between queries is O(1).
+typedef struct
+{
+  int *nodes;
+  int *offsets;
+  int *lengths;
+  int num_paths;
+  int paths_capacity;
+  int nodes_used;
+  int nodes_capacity;
+} PathArena;
+
+void init_path_arena(PathArena *arena)
+{
+  arena->paths_capacity = 64;
+  arena->nodes_capacity = 1024;
+  arena->nodes = (int *)malloc(arena->nodes_capacity * sizeof(int));
+  arena->offsets = (int *)malloc(arena->paths_capacity * sizeof(int));
+  arena->lengths = (int *)malloc(arena->paths_capacity * sizeof(int));
+  arena->num_paths = 0;
+  arena->nodes_used = 0;
+}
+
+void reset_path_arena(PathArena *arena)
+{
+  arena->num_paths = 0;
+  arena->nodes_used = 0;
+}
+
+void free_path_arena(PathArena *arena)
+{
+  free(arena->nodes);
+  free(arena->offsets);
+  free(arena->lengths);
+  arena->nodes = NULL;
+  arena->offsets = NULL;
+  arena->lengths = NULL;
+}
+
+// Copies path into the arena and returns its handle. Pointers returned by
+// arena_path() are invalidated by this call, so path must not point into the
+// same arena.
+int add_path(PathArena *arena, int path[], int length)
+{
+  if (arena->num_paths == arena->paths_capacity)
+  {
+    arena->paths_capacity *= 2;
+    arena->offsets = (int *)realloc(arena->offsets, arena->paths_capacity * sizeof(int));
+    arena->lengths = (int *)realloc(arena->lengths, arena->paths_capacity * sizeof(int));
+  }
+
+  if (arena->nodes_used + length > arena->nodes_capacity)
+  {
+    while (arena->nodes_used + length > arena->nodes_capacity)
+      arena->nodes_capacity *= 2;
+    arena->nodes = (int *)realloc(arena->nodes, arena->nodes_capacity * sizeof(int));
+  }
+
+  int handle = arena->num_paths++;
+  arena->offsets[handle] = arena->nodes_used;
+  arena->lengths[handle] = length;
+  memcpy(arena->nodes + arena->nodes_used, path, length * sizeof(int));
+  arena->nodes_used += length;
+  return handle;
+}
+
+int *arena_path(PathArena *arena, int handle)
+{
+  return arena->nodes + arena->offsets[handle];
+}
+
+int arena_path_length(PathArena *arena, int handle)
+{
+  return arena->lengths[handle];
+}
+
+int check_same_path(int path1[], int length1, int path2[], int length2)
+{
+  if (length1 != length2)
+    return 0;
+
+  for (int i = 0; i < length1; i++)
+  {
+    if (path1[i] != path2[i])
+      return 0;
+  }
+  return 1;
+}
+
+// Joins root_path with sub_path, whose first node is the last node of the
+// root. Returns the length written to concat_path.
+int concat_path(int root_path[], int root_length, int sub_path[], int sub_length, int concat_path[])
+{
+  memcpy(concat_path, root_path, root_length * sizeof(int));
+  memcpy(concat_path + root_length, sub_path + 1, (sub_length - 1) * sizeof(int));
+  return root_length + sub_length - 1;
+}
+
+// FNV-1a hash of the node sequence.
+unsigned int hash_path(int path[], int length)
+{
+  unsigned int hash = 2166136261u;
+  for (int i = 0; i < length; i++)
+  {
+    hash = (hash ^ (unsigned int)path[i]) * 16777619u;
+  }
+  return hash ^ (unsigned int)length;
+}
+
+// Open addressing hash set over the paths of one arena, used to reject
+// duplicate candidates in O(path length) whatever the number of found or
+// queued paths. Equal hashes are confirmed by comparing the node sequences.
+typedef struct
+{
+  unsigned int *hashes;
+  int *handles;
+  int capacity;
+  int size;
+} PathSet;
+
+void init_path_set(PathSet *set)
+{
+  set->capacity = 64;
+  set->size = 0;
+  set->hashes = (unsigned int *)malloc(set->capacity * sizeof(unsigned int));
+  set->handles = (int *)malloc(set->capacity * sizeof(int));
+  memset(set->handles, -1, set->capacity * sizeof(int));
+}
+
+void reset_path_set(PathSet *set)
+{
+  set->size = 0;
+  memset(set->handles, -1, set->capacity * sizeof(int));
+}
+
+void free_path_set(PathSet *set)
+{
+  free(set->hashes);
+  free(set->handles);
+  set->hashes = NULL;
+  set->handles = NULL;
+}
+
+void grow_path_set(PathSet *set)
+{
+  unsigned int *old_hashes = set->hashes;
+  int *old_handles = set->handles;
+  int old_capacity = set->capacity;
+
+  set->capacity *= 2;
+  set->hashes = (unsigned int *)malloc(set->capacity * sizeof(unsigned int));
+  set->handles = (int *)malloc(set->capacity * sizeof(int));
+  memset(set->handles, -1, set->capacity * sizeof(int));
+
+  for (int i = 0; i < old_capacity; i++)
+  {
+    if (old_handles[i] == -1)
+      continue;
+
+    int slot = old_hashes[i] & (set->capacity - 1);
+    while (set->handles[slot] != -1)
+      slot = (slot + 1) & (set->capacity - 1);
+    set->hashes[slot] = old_hashes[i];
+    set->handles[slot] = old_handles[i];
+  }
+
+  free(old_hashes);
+  free(old_handles);
+}
+
+// Adds path to the arena unless the set already holds the same node
+// sequence. Returns the new handle, or -1 for a duplicate.
+int add_unique_path(PathSet *set, PathArena *arena, int path[], int length)
+{
+  if (2 * (set->size + 1) > set->capacity)
+    grow_path_set(set);
+
+  unsigned int hash = hash_path(path, length);
+  int slot = hash & (set->capacity - 1);
+
+  while (set->handles[slot] != -1)
+  {
+    int handle = set->handles[slot];
+    if (set->hashes[slot] == hash &&
+        check_same_path(path, length, arena_path(arena, handle), arena_path_length(arena, handle)))
+      return -1; // Path exists, discard it
+
+    slot = (slot + 1) & (set->capacity - 1);
+  }
+
+  int handle = add_path(arena, path, length);
+  set->hashes[slot] = hash;
+  set->handles[slot] = handle;
+  set->size++;
+  return handle;
+}
+
+#endif
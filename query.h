@@ -0,0 +1,99 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "queue.h"
+#include "path.h"
+
+typedef struct
+{
+  int source;
+  int sink;
+  int K;
+} Query;
+
+// Parses one "source sink [K]" query line, using default_K when K is left
+// out. Returns 1 for a valid query, 0 for a blank or # comment line and -1
+// for anything else.
+int parse_query(const char *line, int default_K, int num_nodes, Query *query)
+{
+  while (*line == ' ' || *line == '\t')
+    line++;
+  if (*line == '#' || *line == '\n' || *line == '\r' || *line == '\0')
+    return 0;
+
+  int fields = sscanf(line, "%d %d %d", &query->source, &query->sink, &query->K);
+  if (fields == 2)
+    query->K = default_K;
+
+  if (fields < 2 || query->K < 1 || query->source < 0 || query->source >= num_nodes ||
+      query->sink < 0 || query->sink >= num_nodes)
+    return -1;
+  return 1;
+}
+
+// Reads a query file with one query line per query (see parse_query()).
+// Returns the queries and stores their number in num_queries, or NULL if the
+// file cannot be used.
+Query *load_queries(const char *filename, int default_K, int num_nodes, int *num_queries)
+{
+  FILE *file = fopen(filename, "r");
+  if (file == NULL)
+  {
+    fprintf(stderr, "Error opening query file %s.\n", filename);
+    return NULL;
+  }
+
+  int capacity = 64, count = 0;
+  Query *queries = (Query *)malloc(capacity * sizeof(Query));
+
+  char line[256];
+  int line_number = 0;
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    line_number++;
+
+    Query query;
+    int parsed = parse_query(line, default_K, num_nodes, &query);
+    if (parsed == 0)
+      continue;
+    if (parsed < 0)
+    {
+      fprintf(stderr, "Skipping invalid query on line %d of %s.\n", line_number, filename);
+      continue;
+    }
+
+    if (count == capacity)
+    {
+      capacity *= 2;
+      queries = (Query *)realloc(queries, capacity * sizeof(Query));
+    }
+    queries[count++] = query;
+  }
+  fclose(file);
+
+  *num_queries = count;
+  return queries;
+}
+
+// Writes the result of one query: a "Query i: source s sink t paths n" line
+// followed by one "cost node node ..." line per path.
+void write_query_paths(FILE *out, int index, Query *query, PathCostPair K_paths[], int found, PathArena *arena)
+{
+  fprintf(out, "Query %d: source %d sink %d paths %d\n", index, query->source, query->sink, found);
+  for (int i = 0; i < found; i++)
+  {
+    int *path = arena_path(arena, K_paths[i].handle);
+    int length = arena_path_length(arena, K_paths[i].handle);
+
+    fprintf(out, "%d", K_paths[i].cost);
+    for (int n = 0; n < length; n++)
+    {
+      fprintf(out, " %d", path[n]);
+    }
+    fprintf(out, "\n");
+  }
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Sends query lines (from a file or standard input) to a server started
+// with -l, one at a time, printing each answer as it arrives and the mean
+// latency per query at the end. A "stats" line asks for the counters of the
+// result cache and a "shutdown" line stops the server.
+//
+//   ./queryClient socket [queries.txt]
+
+double now()
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2 || argc > 3)
+  {
+    printf("Usage: %s socket [queries.txt]\n", argv[0]);
+    return 1;
+  }
+
+  FILE *queries = stdin;
+  if (argc == 3 && (queries = fopen(argv[2], "r")) == NULL)
+  {
+    printf("Error opening query file %s.\n", argv[2]);
+    return 1;
+  }
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+  {
+    printf("Error connecting to %s.\n", argv[1]);
+    return 1;
+  }
+  FILE *in = fdopen(fd, "r");
+  FILE *out = fdopen(dup(fd), "w");
+
+  char *line = NULL, *answer = NULL;
+  size_t line_capacity = 0, answer_capacity = 0;
+  int num_queries = 0;
+  double total_latency = 0;
+
+  while (getline(&line, &line_capacity, queries) != -1)
+  {
+    char *start = line;
+    while (*start == ' ' || *start == '\t')
+      start++;
+    if (*start == '#' || *start == '\n' || *start == '\r' || *start == '\0')
+      continue;
+
+    double start_time = now();
+    fputs(start, out);
+    fflush(out);
+    if (strncmp(start, "shutdown", 8) == 0)
+      break;
+
+    // a "Query ... paths n" header and n path lines, or one other line
+    if (getline(&answer, &answer_capacity, in) == -1)
+    {
+      printf("Server closed the connection.\n");
+      break;
+    }
+    fputs(answer, stdout);
+
+    // only answers to queries count towards the latency
+    char *paths = strstr(answer, " paths ");
+    int answered = strncmp(answer, "Query", 5) == 0;
+    int found = (answered && paths != NULL) ? atoi(paths + 7) : 0;
+    for (int i = 0; i < found && getline(&answer, &answer_capacity, in) != -1; i++)
+    {
+      fputs(answer, stdout);
+    }
+
+    if (answered)
+    {
+      total_latency += now() - start_time;
+      num_queries++;
+    }
+  }
+
+  if (num_queries > 0)
+    fprintf(stderr, "%d queries, mean latency %.3f ms\n", num_queries, 1000 * total_latency / num_queries);
+
+  free(line);
+  free(answer);
+  fclose(in);
+  fclose(out);
+  if (queries != stdin)
+    fclose(queries);
+  return 0;
+}
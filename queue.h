@@ -1,24 +1,68 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
 #include <stdio.h>
 #include <stdlib.h>
 
-#define MAX_NODES 336
-#define MAX_PATHS 50
-
+// Queue entries only carry the cost and a handle to a path stored elsewhere
+// (see PathArena in path.h), so sifting moves 8 bytes per swap no matter how
+// long the paths are.
 typedef struct 
 {
-  int path[MAX_NODES];
   int cost;
+  int handle;
 } PathCostPair;
 
+// Growable binary min-heap. With limit > 0 the queue is bounded: only the
+// limit cheapest entries are guaranteed to be kept, the rest are dropped in
+// batches once the heap holds twice that many.
 typedef struct 
 {
-  PathCostPair pairs[MAX_PATHS];
+  PathCostPair *pairs;
   int size;
+  int capacity;
+  int limit;
 } PriorityQueue;
 
 void initialize(PriorityQueue *pq) 
 {
+  pq->capacity = 16;
+  pq->pairs = (PathCostPair *)malloc(pq->capacity * sizeof(PathCostPair));
+  pq->size = 0;
+  pq->limit = 0;
+}
+
+void free_queue(PriorityQueue *pq) 
+{
+  free(pq->pairs);
+  pq->pairs = NULL;
   pq->size = 0;
+  pq->capacity = 0;
+}
+
+int compare_pairs(const void *a, const void *b) 
+{
+  int cost_a = ((const PathCostPair *)a)->cost;
+  int cost_b = ((const PathCostPair *)b)->cost;
+  return (cost_a > cost_b) - (cost_a < cost_b);
+}
+
+// Keeps the limit cheapest entries. A sorted array is already a valid
+// min-heap, so no rebuild is needed afterwards.
+void trim_queue(PriorityQueue *pq) 
+{
+  if (pq->limit <= 0 || pq->size <= pq->limit)
+    return;
+
+  qsort(pq->pairs, pq->size, sizeof(PathCostPair), compare_pairs);
+  pq->size = pq->limit;
+}
+
+void set_queue_limit(PriorityQueue *pq, int limit) 
+{
+  pq->limit = limit;
+  if (pq->limit > 0 && pq->size >= 2 * pq->limit)
+    trim_queue(pq);
 }
 
 void swap(PathCostPair *a, PathCostPair *b) 
@@ -45,10 +89,13 @@ int rightChild(int i)
 
 void insert(PriorityQueue *pq, PathCostPair newPair) 
 {
-    if (pq->size == MAX_PATHS) 
+    if (pq->limit > 0 && pq->size >= 2 * pq->limit)
+      trim_queue(pq);
+
+    if (pq->size == pq->capacity) 
     {
-      printf("Priority Queue is full!\n");
-      return;
+      pq->capacity *= 2;
+      pq->pairs = (PathCostPair *)realloc(pq->pairs, pq->capacity * sizeof(PathCostPair));
     }
 
     int i = pq->size;
@@ -101,4 +148,6 @@ PathCostPair extractMin(PriorityQueue *pq)
   heapify(pq, 0);
 
   return root;
-}
\ No newline at end of file
+}
+
+#endif
@@ -1,256 +1,231 @@
-
 #include <stdio.h>
 #include <stdlib.h>
 #include "queue.h"
+#include "graph.h"
+#include "dijkstra.h"
+#include "path.h"
+#include "yen.h"
+#include "ksp.h"
+#include "query.h"
+#include "server.h"
 #include <limits.h>
 #include <time.h>
+#include <unistd.h>
 
-#define INF 1000000
-#define MAX_NODES 336
 #define RAND_PAIRS 10
 
-void remove_edge(int i, int j, int *graph[MAX_NODES]) 
-{
-  graph[i][j] = INF;
-  graph[j][i] = INF;
-}
-
-void print_path(int path[]) 
+void print_path(int path[], int length)
 {
   printf("|| Path ||\n");
-  for (int i = 0; i < MAX_NODES; i++) 
-  {
-    if (path[i] != -1)
-      printf("%d -> ", path[i]);
-  }
-}
-
-void copy_path(int path[], int path_copy[]) 
-{
-  for (int i = 0; i < MAX_NODES; i++) {
-    path_copy[i] = path[i];
-  }
-}
-
-void save_shortest_path(int source, int sink, int predecessors[], int path[]) 
-{
-  int index = 0;
-  for (int v = sink; v != source; v = predecessors[v]) 
-  {
-    path[index++] = v;
-  }
-  path[index] = source;
-
-  // Reverse the path
-  int temp = 0, start = 0;
-  while (start < index) {
-    temp = path[start];
-    path[start] = path[index];
-    path[index] = temp;
-    start++;
-    index--;
-  }
-}
-
-int get_path_length(int path[]) 
-{
-  int len = 0;
-  for (int i = 0; i < MAX_NODES; i++) 
+  for (int i = 0; i < length; i++)
   {
-    if (path[i] != -1)
-      len++;
+    printf("%d -> ", path[i]);
   }
-  return len;
 }
 
-int get_min_vertex(int distances[], int visited[]) 
+int main(int argc, char *argv[])
 {
-  int min = INF, min_index = -1;
+  const char *filename = "mapped-new-who.txt";
+  const char *query_file = NULL;
+  const char *output_file = NULL;
+  const char *socket_path = NULL;
+  int K = 20;
+  int server_max_K = DEFAULT_SERVER_MAX_K;
+  int cache_size = 0;
 
-  for (int vertex = 0; vertex < MAX_NODES; vertex++) 
+  int opt;
+  while ((opt = getopt(argc, argv, "a:c:e:f:k:K:l:m:q:o:")) != -1)
   {
-    if (visited[vertex] == 0 && distances[vertex] <= min) 
+    switch (opt)
     {
-      min = distances[vertex];
-      min_index = vertex;
+      case 'a':
+        if (set_ksp_algorithm(optarg) != 0)
+        {
+          fprintf(stderr, "Unknown algorithm %s (use yen, pnc or lazy).\n", optarg);
+          return 1;
+        }
+        break;
+      case 'c':
+        cache_size = atoi(optarg);
+        break;
+      case 'e':
+        if (set_dijkstra_engine(optarg) != 0)
+        {
+          fprintf(stderr, "Unknown Dijkstra engine %s (use scan, heap, bucket or bidir).\n", optarg);
+          return 1;
+        }
+        break;
+      case 'f':
+        filename = optarg;
+        break;
+      case 'k':
+        K = atoi(optarg);
+        if (K < 1)
+        {
+          fprintf(stderr, "K must be at least 1.\n");
+          return 1;
+        }
+        break;
+      case 'K':
+        server_max_K = atoi(optarg);
+        if (server_max_K < 1)
+        {
+          fprintf(stderr, "The largest K must be at least 1.\n");
+          return 1;
+        }
+        break;
+      case 'l':
+        socket_path = optarg;
+        break;
+      case 'm':
+        if (set_tree_cache_budget(optarg) != 0)
+        {
+          fprintf(stderr, "The tree cache budget must be a positive number of megabytes.\n");
+          return 1;
+        }
+        break;
+      case 'q':
+        query_file = optarg;
+        break;
+      case 'o':
+        output_file = optarg;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-a yen|pnc|lazy] [-c cache_entries] [-e scan|heap|bucket|bidir] [-f graph_file] [-k K] [-m tree_megabytes] [-q query_file [-o output_file] | -l socket [-K max_K]]\n", argv[0]);
+        return 1;
     }
   }
-  return min_index;
-}
-
-int dijkstra(int source, int sink, int *graph[MAX_NODES], int shortest_path[]) 
-{
-  int visited[MAX_NODES];
-  int distance[MAX_NODES];
-  int predecessors[MAX_NODES];
-
-  for (int i = 0; i < MAX_NODES; i++) 
-  {
-    distance[i] = INF;
-    visited[i] = 0;
-    shortest_path[i] = -1;
-    predecessors[i] = -1;
-  }
 
-  distance[source] = 0;
+  srand(time(NULL));
+  clock_t start = clock();
 
-  for (int i = 0; i < MAX_NODES - 1; i++) 
+  Graph graph;
+  if (load_graph(filename, &graph) != 0)
   {
-    int curr_min_vertex = get_min_vertex(distance, visited);
-    visited[curr_min_vertex] = 1;
-
-    for (int adj_v = 0; adj_v < MAX_NODES; adj_v++) 
-    {
-      //dist[curr_min_vertex] != INF, if node is unreachable, its dist is INF 
-      if (visited[adj_v] != 1 && graph[curr_min_vertex][adj_v] && distance[curr_min_vertex] != INF && distance[curr_min_vertex] + graph[curr_min_vertex][adj_v] < distance[adj_v]) 
-      {
-        distance[adj_v] = distance[curr_min_vertex] + graph[curr_min_vertex][adj_v];
-        predecessors[adj_v] = curr_min_vertex;
-      }
-    }
+    return 1; // Exit if file opening fails
   }
 
-  if (distance[sink] != INF) 
-  {
-    save_shortest_path(source, sink, predecessors, shortest_path);
-  }
+  int num_nodes = graph.num_nodes;
 
-  return distance[sink];
-}
+  YenWorkspace ws;
+  init_yen_workspace(&ws, &graph);
 
-int check_same_path(int path1[], int path2[]) 
-{
-  for (int i = 0; i < MAX_NODES; i++) 
+  ResultCache cache;
+  if (cache_size > 0)
   {
-    if (path1[i] != path2[i])
-      return 0;
+    init_result_cache(&cache, cache_size);
+    ws.cache = &cache;
   }
-  return 1;
-}
 
-void extract_sub_path(int path[], int sub_path[], int curr_node) 
-{
-  int curr_node_idx = -1;
-  for (int i = 0; i < MAX_NODES; i++) 
+  if (socket_path != NULL)
   {
-    if (path[i] == curr_node) 
+    // server mode: the graph stays loaded while clients send queries
+    QueryServer server;
+    if (open_query_server(&server, socket_path) != 0)
+      return 1;
+    server.cache = ws.cache;
+    server.max_K = server_max_K;
+    printf("Listening on %s\n", socket_path);
+    fflush(stdout);
+
+    int K_capacity = K;
+    PathCostPair *K_paths = (PathCostPair *)malloc(K_capacity * sizeof(PathCostPair));
+    Query query;
+    int num_queries = 0;
+    while (next_query(&server, K, num_nodes, &query))
     {
-      sub_path[i] = path[i];
-      curr_node_idx = i;
+      if (query.K > K_capacity)
+      {
+        PathCostPair *grown = (PathCostPair *)realloc(K_paths, query.K * sizeof(PathCostPair));
+        if (grown == NULL)
+        {
+          reject_query(&server);
+          continue;
+        }
+        K_paths = grown;
+        K_capacity = query.K;
+      }
+      int found = k_shortest_paths(&graph, query.source, query.sink, query.K, &ws, K_paths);
+      if (found < 0)
+      {
+        reject_query(&server);
+        continue;
+      }
+      answer_query(&server, &query, K_paths, found, &ws.arena);
+      num_queries++;
     }
-
-    if (curr_node_idx == -1) // means we have not reached curr node yet
-      sub_path[i] = path[i];
-
-    else if (curr_node_idx != -1 && i > curr_node_idx) // means we have reached curr node
-      sub_path[i] = -1;
+    close_query_server(&server);
+    printf("Served %d queries\n", num_queries);
+    if (ws.cache != NULL)
+      print_cache_stats(stdout, ws.cache);
+    print_tree_cache_stats(stdout, &ws.trees);
+
+    free(K_paths);
+    free_yen_workspace(&ws);
+    if (ws.cache != NULL)
+      free_result_cache(&cache);
+    free_graph(&graph);
+    return 0;
   }
-}
 
-void concat_path(int root_path[], int sub_path[], int concat_path[]) 
-{
-  int idx = 0;
-  for (int i = 0; i < MAX_NODES; i++) 
+  if (query_file != NULL)
   {
-    if (root_path[i] != -1) 
-    {
-      concat_path[i] = root_path[i];
-    } 
-    else 
-    {
-      concat_path[i] = sub_path[++idx];
-    }
-  }
-}
+    // batch mode: answer every query of the file, in order
+    int num_queries;
+    Query *queries = load_queries(query_file, K, num_nodes, &num_queries);
+    if (queries == NULL)
+      return 1;
 
-void copy_graph(int *graph[MAX_NODES], int *copy_graph[MAX_NODES]) 
-{
-  for (int i = 0; i < MAX_NODES; i++) 
-  {
-    for (int j = 0; j < MAX_NODES; j++) 
+    FILE *out = stdout;
+    if (output_file != NULL && (out = fopen(output_file, "w")) == NULL)
     {
-      copy_graph[i][j] = graph[i][j];
-    }
-  }
-}
-
-int path_exists(int *path, int **K_paths, int K, PriorityQueue pq) 
-{
-  // Check in priority queue
-  for (int i = 0; i < pq.size; i++) 
-  {
-    if (check_same_path(path, pq.pairs[i].path))
-      return 1; 
-  }
-
-  // Check in K_paths matrix
-  for (int i = 0; i < K; i++) 
-  {
-    if (check_same_path(path, K_paths[i]))
+      fprintf(stderr, "Error opening output file %s.\n", output_file);
       return 1;
-  }
-
-  return 0; 
-}
-
-int main(int argc, char *argv[]) 
-{
-  srand(time(NULL));
-  clock_t start = clock();
+    }
 
-  int **graph = (int **)malloc(MAX_NODES * sizeof(int *));
-  for (int i = 0; i < MAX_NODES; i++) 
-  {
-    graph[i] = (int *)malloc(MAX_NODES * sizeof(int));
-    for (int j = 0; j < MAX_NODES; j++) 
+    int max_K = 1;
+    for (int q = 0; q < num_queries; q++)
     {
-      graph[i][j] = 0;
+      if (queries[q].K > max_K)
+        max_K = queries[q].K;
     }
-  }
-  
-  int** org_graph = (int **)malloc(MAX_NODES * sizeof(int *));
-  for (int i = 0; i < MAX_NODES; i++) 
-  {
-    org_graph[i] = (int *)malloc(MAX_NODES * sizeof(int));
-    for (int j = 0; j < MAX_NODES; j++) 
+    PathCostPair *K_paths = (PathCostPair *)malloc(max_K * sizeof(PathCostPair));
+
+    for (int q = 0; q < num_queries; q++)
     {
-        org_graph[i][j] = 0;
+      int found = k_shortest_paths(&graph, queries[q].source, queries[q].sink, queries[q].K, &ws, K_paths);
+      if (found < 0)
+      {
+        fprintf(stderr, "Out of memory for the paths of query %d.\n", q);
+        return 1;
+      }
+      write_query_paths(out, q, &queries[q], K_paths, found, &ws.arena);
     }
-  }
 
-  FILE *file = fopen("mapped-new-who.txt", "r"); 
-  if (file == NULL) 
-  {
-    fprintf(stderr, "Error opening file.\n");
-    return 1; // Exit if file opening fails
-  }
-
-  // Skip the first two lines
-  char line[100];
-  void* ptr = fgets(line, sizeof(line), file); // Skip the first line
-  ptr = fgets(line, sizeof(line), file); // Skip the second line
-
-  // Read data from the file and populate the graph
-  int from_node, to_node, weight;
-  while (fscanf(file, "%d %d %d", &from_node, &to_node, &weight) == 3) 
-  {
-    graph[from_node][to_node] = weight;
+    if (out != stdout)
+      fclose(out);
+
+    clock_t end = clock();
+    printf("\nExecution time for serial code: %f (%d queries)\n\n", (double)(end - start) / CLOCKS_PER_SEC, num_queries);
+    if (ws.cache != NULL)
+      print_cache_stats(stdout, ws.cache);
+    print_tree_cache_stats(stdout, &ws.trees);
+
+    free(K_paths);
+    free(queries);
+    free_yen_workspace(&ws);
+    if (ws.cache != NULL)
+      free_result_cache(&cache);
+    free_graph(&graph);
+    return 0;
   }
-  copy_graph(graph, org_graph);
-  fclose(file);
 
-  copy_graph(graph, org_graph);
-  
-  int K = 20;
-
-  int **K_paths = (int **)malloc(K * sizeof(int *));
-  for (int i = 0; i < K; i++) 
-  {
-    K_paths[i] = (int *)malloc(MAX_NODES * sizeof(int));
-  }
-  
-  int *K_costs = (int *)malloc(K * sizeof(int));
+  // the K paths of every pair, kept for printing
+  PathArena results;
+  init_path_arena(&results);
 
+  PathCostPair *all_K_paths[RAND_PAIRS];
+  int all_found[RAND_PAIRS];
   int all_sources[RAND_PAIRS];
   int all_sinks[RAND_PAIRS];
 
@@ -258,121 +233,59 @@ int main(int argc, char *argv[])
   {
     int source, sink;
 
-    PriorityQueue pq;
-    initialize(&pq);
-    
-    source = rand() % MAX_NODES;
-    sink = rand() % MAX_NODES;
+    PathCostPair *K_paths = (PathCostPair *)malloc(K * sizeof(PathCostPair));
+
+    source = rand() % num_nodes;
+    sink = rand() % num_nodes;
 
     all_sources[rand_pair] = source;
     all_sinks[rand_pair] = sink;
 
-    int path[MAX_NODES];
-    int cost = 0;
-
-    cost = dijkstra(source, sink, graph, path);
-    K_costs[0] = cost;
+    int found = k_shortest_paths(&graph, source, sink, K, &ws, K_paths);
 
-    // add to K shortest path and cost
-    copy_path(path, K_paths[0]);
-
-    for (int k = 1; k < K; k++) // for k=0, first path above
+    for (int i = 0; i < found; i++)
     {
-      int curr_path[MAX_NODES];
-      copy_path(K_paths[k - 1], curr_path);
-      int len = get_path_length(curr_path);
-
-      for (int i = 0; i < len - 1; i++) 
-      {
-        int curr_node = curr_path[i];
-        int src_to_curr_cost = dijkstra(source, curr_node, org_graph, path);
-
-        int ri[MAX_NODES];
-        extract_sub_path(curr_path, ri, curr_node);
-
-        for (int j = 0; j <= k - 1; j++) 
-        {
-          int jth_path[MAX_NODES];
-          copy_path(K_paths[j], jth_path);
-          int rj[MAX_NODES];
-          extract_sub_path(jth_path, rj, curr_node);
-
-          if (check_same_path(ri, rj)) 
-          {
-            int next_node = jth_path[i + 1];
-            remove_edge(curr_node, next_node, graph);
-          }
-        }
-
-        int si[MAX_NODES];
-        int Cost = dijkstra(curr_node, sink, graph, si);
-
-        if (Cost != INF) 
-        {
-          PathCostPair pair;
-
-          concat_path(ri, si, pair.path);
-          pair.cost = Cost + src_to_curr_cost;
-
-          if (!path_exists(pair.path, K_paths, K, pq))
-            insert(&pq, pair);
-        }
-      }
-
-      // restore graph
-      copy_graph(org_graph, graph);
-
-      // add min shortest path to K_paths
-      PathCostPair minPair;
-      if (pq.size > 0) 
-      {
-        minPair = extractMin(&pq);
-      }
-
-      // minPair.path and minPair.cost
-      copy_path(minPair.path, K_paths[k]);
-      K_costs[k] = minPair.cost;
+      int handle = K_paths[i].handle;
+      K_paths[i].handle = add_path(&results, arena_path(&ws.arena, handle), arena_path_length(&ws.arena, handle));
     }
+
+    all_K_paths[rand_pair] = K_paths;
+    all_found[rand_pair] = found;
   }
- 
+
   for(int rp=0; rp<RAND_PAIRS; rp++)
   {
     printf("\n-----------------------------------------------------------");
     printf("\nSource: %d, Sink: %d\n", all_sources[rp], all_sinks[rp]);
     printf("-----------------------------------------------------------\n");
-    for (int i = 0; i < K; i++) 
+    if (all_found[rp] == 0)
+      printf("\nNo path found\n");
+
+    for (int i = 0; i < all_found[rp]; i++)
     {
       printf("\nk = %d\n", i + 1);
-      print_path(K_paths[i]);
-      printf("COST: %d\n", K_costs[i]);
+      int handle = all_K_paths[rp][i].handle;
+      print_path(arena_path(&results, handle), arena_path_length(&results, handle));
+      printf("COST: %d\n", all_K_paths[rp][i].cost);
     }
   }
-  
+
   clock_t end = clock();
   double cpu_time = (double)(end - start) / CLOCKS_PER_SEC;
 
   printf("\nExecution time for serial code: %f\n\n", cpu_time);
 
   // free memory
-  for (int i = 0; i < MAX_NODES; i++) 
-  {
-    free(graph[i]);
-  }
-  free(graph);
-
-  for (int i = 0; i < MAX_NODES; i++) 
-  {
-    free(org_graph[i]);
-  }
-  free(org_graph);
+  free_graph(&graph);
+  free_yen_workspace(&ws);
+  if (ws.cache != NULL)
+    free_result_cache(&cache);
 
-  for (int i = 0; i < K; i++) 
+  for (int rp = 0; rp < RAND_PAIRS; rp++)
   {
-    free(K_paths[i]);
+    free(all_K_paths[rp]);
   }
-  free(K_paths);
-
-  free(K_costs);
+  free_path_arena(&results);
 
   return 0;
-}
\ No newline at end of file
+}
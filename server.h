@@ -0,0 +1,232 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "queue.h"
+#include "path.h"
+#include "query.h"
+#include "cache.h"
+
+// Query server on a local (Unix domain) socket, so the graph is loaded once
+// and stays resident across requests. Clients connect one at a time and
+// send query lines as in a query file (see parse_query()); each query is
+// answered as soon as it is read, in the format of write_query_paths(), and
+// an invalid line, or a query for more than max_K paths, with one
+// "Error: ..." line. A "stats" line is answered
+// with the counters of the result cache and a "shutdown" line stops the
+// server. queryClient.c is a simple client.
+
+typedef struct
+{
+  const char *path;
+  int listen_fd;
+  FILE *in;          // current client, NULL between clients
+  FILE *out;
+  int line_number;
+  int query_index;   // queries answered on the current connection
+  char *line;
+  size_t line_capacity;
+  ResultCache *cache;  // reported by "stats", may be NULL
+  int max_K;           // larger K are refused, set with -K
+  dev_t socket_dev;    // the socket file bound here, the only one
+  ino_t socket_ino;    // close_query_server() removes
+} QueryServer;
+
+// Default of max_K: a client must not be able to make the server allocate
+// without bound.
+#define DEFAULT_SERVER_MAX_K 100000
+
+// Removes the socket at path if no server answers on it any more. Returns
+// 0 if path is now free, or -1 with a message if it is not a socket or a
+// server may still be listening on it.
+int remove_stale_socket(const char *path, const struct sockaddr_un *address)
+{
+  struct stat info;
+  if (lstat(path, &info) != 0)
+  {
+    if (errno == ENOENT)
+      return 0;
+    fprintf(stderr, "Error checking %s: %s.\n", path, strerror(errno));
+    return -1;
+  }
+  if (!S_ISSOCK(info.st_mode))
+  {
+    fprintf(stderr, "%s exists and is not a socket.\n", path);
+    return -1;
+  }
+
+  // only a refused connection shows that nobody listens any more
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  int stale = fd != -1 && connect(fd, (const struct sockaddr *)address, sizeof(*address)) != 0 &&
+              errno == ECONNREFUSED;
+  if (fd != -1)
+    close(fd);
+  if (!stale)
+  {
+    fprintf(stderr, "Socket %s is in use or cannot be checked.\n", path);
+    return -1;
+  }
+  unlink(path);
+  return 0;
+}
+
+// Listens on the socket at path, replacing a stale one but never another
+// file or a live server's socket. Returns 0, or -1 with a message if the
+// socket cannot be set up.
+int open_query_server(QueryServer *server, const char *path)
+{
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path))
+  {
+    fprintf(stderr, "Socket path %s is too long.\n", path);
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  server->path = path;
+  server->in = NULL;
+  server->out = NULL;
+  server->line = NULL;
+  server->line_capacity = 0;
+  server->cache = NULL;
+  server->max_K = DEFAULT_SERVER_MAX_K;
+  server->socket_dev = 0;
+  server->socket_ino = 0;
+  if (remove_stale_socket(path, &address) != 0)
+    return -1;
+
+  server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server->listen_fd == -1 || bind(server->listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+  {
+    fprintf(stderr, "Error listening on %s: %s.\n", path, strerror(errno));
+    if (server->listen_fd != -1)
+      close(server->listen_fd);
+    return -1;
+  }
+
+  struct stat info;
+  if (lstat(path, &info) == 0)
+  {
+    server->socket_dev = info.st_dev;
+    server->socket_ino = info.st_ino;
+  }
+  if (listen(server->listen_fd, 8) != 0)
+  {
+    fprintf(stderr, "Error listening on %s: %s.\n", path, strerror(errno));
+    close(server->listen_fd);
+    unlink(path);
+    return -1;
+  }
+
+  // a client that hangs up early must not take the server down
+  signal(SIGPIPE, SIG_IGN);
+  return 0;
+}
+
+void close_client(QueryServer *server)
+{
+  if (server->in != NULL)
+  {
+    fclose(server->in);
+    fclose(server->out);
+    server->in = NULL;
+    server->out = NULL;
+  }
+}
+
+// Waits for the next valid query, accepting clients as earlier ones hang
+// up. Returns 1 with the query in query, or 0 once a client asks the server
+// to shut down.
+int next_query(QueryServer *server, int default_K, int num_nodes, Query *query)
+{
+  while (1)
+  {
+    if (server->in == NULL)
+    {
+      int fd = accept(server->listen_fd, NULL, NULL);
+      if (fd == -1)
+        continue;
+      server->in = fdopen(fd, "r");
+      server->out = fdopen(dup(fd), "w");
+      server->line_number = 0;
+      server->query_index = 0;
+    }
+
+    if (getline(&server->line, &server->line_capacity, server->in) == -1)
+    {
+      close_client(server);
+      continue;
+    }
+    server->line_number++;
+
+    if (strncmp(server->line, "shutdown", 8) == 0)
+    {
+      close_client(server);
+      return 0;
+    }
+
+    if (strncmp(server->line, "stats", 5) == 0)
+    {
+      if (server->cache != NULL)
+        print_cache_stats(server->out, server->cache);
+      else
+        fprintf(server->out, "Cache: off\n");
+      fflush(server->out);
+      continue;
+    }
+
+    int parsed = parse_query(server->line, default_K, num_nodes, query);
+    if (parsed == 1 && query->K > server->max_K)
+    {
+      fprintf(server->out, "Error: K above %d on line %d\n", server->max_K, server->line_number);
+      fflush(server->out);
+      continue;
+    }
+    if (parsed == 1)
+      return 1;
+    if (parsed < 0)
+    {
+      fprintf(server->out, "Error: invalid query on line %d\n", server->line_number);
+      fflush(server->out);
+    }
+  }
+}
+
+// Answers the query returned by next_query() with an error instead, when
+// its paths cannot be allocated.
+void reject_query(QueryServer *server)
+{
+  fprintf(server->out, "Error: out of memory on line %d\n", server->line_number);
+  fflush(server->out);
+}
+
+// Sends the paths found for the query returned by next_query().
+void answer_query(QueryServer *server, Query *query, PathCostPair K_paths[], int found, PathArena *arena)
+{
+  write_query_paths(server->out, server->query_index++, query, K_paths, found, arena);
+  fflush(server->out);
+}
+
+void close_query_server(QueryServer *server)
+{
+  close_client(server);
+  close(server->listen_fd);
+
+  // the path may have been replaced since, by another server or a file
+  struct stat info;
+  if (lstat(server->path, &info) == 0 && info.st_dev == server->socket_dev && info.st_ino == server->socket_ino)
+    unlink(server->path);
+  free(server->line);
+}
+
+#endif
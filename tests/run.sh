@@ -0,0 +1,26 @@
+#!/bin/sh
+# Builds serial.c and checks its answers to tests/<name>-queries.txt on
+# tests/<name>.txt against tests/<name>-expected.txt, with every algorithm
+# and engine. Run from the repository root: sh tests/run.sh
+set -e
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+gcc -O2 -fopenmp -o "$out/serial" serial.c -lm
+
+failed=0
+for expected in tests/*-expected.txt; do
+  name=${expected%-expected.txt}
+  for algorithm in yen pnc lazy; do
+    for engine in heap bucket bidir scan; do
+      "$out/serial" -a $algorithm -e $engine -f "$name.txt" -q "$name-queries.txt" -o "$out/paths.txt" > /dev/null
+      if ! cmp -s "$out/paths.txt" "$expected"; then
+        echo "FAIL: $name with -a $algorithm -e $engine"
+        diff "$expected" "$out/paths.txt" || true
+        failed=1
+      fi
+    done
+  done
+done
+
+[ $failed = 0 ] && echo "All tests passed."
+exit $failed
@@ -0,0 +1,116 @@
+#ifndef TREECACHE_H
+#define TREECACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "graph.h"
+#include "dijkstra.h"
+
+// Shortest path trees towards recently used sinks, so that queries sharing
+// a sink (hub nodes come up again and again) skip the backward search that
+// starts each of them. The trees kept are bounded by tree_cache_budget,
+// least recently used first out, but there is always room for one.
+
+// Bytes the trees of one tree cache may take, set with -m; 0 keeps one tree.
+size_t tree_cache_budget = 0;
+
+typedef struct
+{
+  SinkTree *trees;  // slots, allocated as they are first used
+  int *last_used;
+  int capacity;
+  int size;
+  int *slot;        // slot[v] holds the tree of sink v, -1 for none
+  int clock;
+  long long hits;
+  long long misses;
+} SinkTreeCache;
+
+// Sets tree_cache_budget from a size in megabytes. Returns 0, or -1 if the
+// size is not a positive number.
+int set_tree_cache_budget(const char *megabytes)
+{
+  double size = atof(megabytes);
+  if (size <= 0)
+    return -1;
+  tree_cache_budget = (size_t)(size * 1024 * 1024);
+  return 0;
+}
+
+void init_sink_tree_cache(SinkTreeCache *cache, const Graph *graph)
+{
+  size_t tree_size = 3 * (size_t)graph->num_nodes * sizeof(int);
+  // an empty graph gets an empty cache; the loaders refuse such graphs
+  size_t capacity = tree_size > 0 ? tree_cache_budget / tree_size : 0;
+  if (capacity < 1 && graph->num_nodes > 0)
+    capacity = 1;
+  if (capacity > (size_t)graph->num_nodes)
+    capacity = graph->num_nodes;
+
+  cache->capacity = (int)capacity;
+  cache->size = 0;
+  cache->clock = 0;
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->trees = (SinkTree *)malloc(cache->capacity * sizeof(SinkTree));
+  cache->last_used = (int *)malloc(cache->capacity * sizeof(int));
+  cache->slot = (int *)malloc(graph->num_nodes * sizeof(int));
+  memset(cache->slot, -1, graph->num_nodes * sizeof(int));
+}
+
+void free_sink_tree_cache(SinkTreeCache *cache)
+{
+  for (int i = 0; i < cache->size; i++)
+  {
+    free_sink_tree(&cache->trees[i]);
+  }
+  free(cache->trees);
+  free(cache->last_used);
+  free(cache->slot);
+}
+
+// Returns the tree towards sink, building it in a free slot or in place of
+// the least recently used tree if it is not cached. The tree stays valid
+// until a later call evicts it, so never before the next call for another
+// sink.
+const SinkTree *sink_tree(SinkTreeCache *cache, int sink, const Graph *graph)
+{
+  int i = cache->slot[sink];
+  if (i != -1)
+  {
+    cache->hits++;
+  }
+  else
+  {
+    cache->misses++;
+    if (cache->size < cache->capacity)
+    {
+      i = cache->size++;
+      init_sink_tree(&cache->trees[i], graph);
+    }
+    else
+    {
+      i = 0;
+      for (int j = 1; j < cache->capacity; j++)
+      {
+        if (cache->last_used[j] < cache->last_used[i])
+          i = j;
+      }
+      cache->slot[cache->trees[i].sink] = -1;
+    }
+
+    build_sink_tree(&cache->trees[i], sink, graph);
+    cache->slot[sink] = i;
+  }
+
+  cache->last_used[i] = ++cache->clock;
+  return &cache->trees[i];
+}
+
+void print_tree_cache_stats(FILE *out, SinkTreeCache *cache)
+{
+  fprintf(out, "Sink trees: %lld reused, %lld built, room for %d\n", cache->hits, cache->misses, cache->capacity);
+}
+
+#endif
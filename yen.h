@@ -0,0 +1,419 @@
+#ifndef YEN_H
+#define YEN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "queue.h"
+#include "graph.h"
+#include "dijkstra.h"
+#include "path.h"
+#include "treecache.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Yen's loopless K shortest paths, shared by serial.c, the batch mode of
+// parallel.c and, through the spur task helpers, its distributed mode.
+
+// Whether spur searches stop at the first node whose tree path avoids every
+// ban (see dijkstra_classified()) instead of searching until the sink.
+int spur_node_classification = 0;
+
+// Per-thread state for spur searches, so concurrent OpenMP tasks share
+// nothing but the read-only graph.
+typedef struct
+{
+  SearchMask mask;
+  SearchScratch search;
+  int *si;
+  int *candidate;
+  PathArena arena;
+  PathSet seen;
+  PriorityQueue pq;
+  int work_done;
+} SpurScratch;
+
+void init_spur_scratch(SpurScratch *scratch, const Graph *graph)
+{
+  init_mask(&scratch->mask, graph);
+  init_search_scratch(&scratch->search, graph);
+  // paths are loopless, so no path has more nodes than the graph
+  scratch->si = (int *)malloc(graph->num_nodes * sizeof(int));
+  scratch->candidate = (int *)malloc(graph->num_nodes * sizeof(int));
+  init_path_arena(&scratch->arena);
+  init_path_set(&scratch->seen);
+  initialize(&scratch->pq);
+  scratch->work_done = 0;
+}
+
+void reset_spur_scratch(SpurScratch *scratch)
+{
+  reset_path_arena(&scratch->arena);
+  reset_path_set(&scratch->seen);
+  scratch->pq.size = 0;
+}
+
+void free_spur_scratch(SpurScratch *scratch)
+{
+  free_mask(&scratch->mask);
+  free_search_scratch(&scratch->search);
+  free(scratch->si);
+  free(scratch->candidate);
+  free_path_arena(&scratch->arena);
+  free_path_set(&scratch->seen);
+  free_queue(&scratch->pq);
+}
+
+// Runs one packed spur task (see build_spur_tasks()) towards the sink of
+// tree and queues the candidate path, if any, in the scratch of the calling
+// thread.
+void run_spur_task(int task[], const SinkTree *tree, const Graph *graph, SpurScratch *scratch)
+{
+  int src_to_curr_cost = task[0];
+  int root_length = task[1];
+  int *ri = task + 2;
+  int num_banned = task[2 + root_length];
+  int *banned = task + 3 + root_length;
+
+  int curr_node = ri[root_length - 1];
+
+  // ban the root nodes before the spur node and the edges to the next
+  // nodes of the found paths sharing the root
+  for (int r = 0; r < root_length - 1; r++)
+  {
+    ban_node(&scratch->mask, ri[r]);
+  }
+  for (int b = 0; b < num_banned; b++)
+  {
+    ban_edge(&scratch->mask, graph, curr_node, banned[b]);
+  }
+
+  int si_length;
+  int Cost = spur_node_classification
+               ? dijkstra_classified(curr_node, tree, graph, &scratch->mask, &scratch->search, scratch->si, &si_length)
+               : dijkstra(curr_node, tree->sink, graph, &scratch->mask, tree, &scratch->search, scratch->si, &si_length);
+  clear_mask(&scratch->mask);
+  scratch->work_done++;
+
+  // a candidate costing INF or more is out of range, as if there were none
+  Cost = add_cost(Cost, src_to_curr_cost);
+  if (Cost != INF)
+  {
+    int candidate_length = concat_path(ri, root_length, scratch->si, si_length, scratch->candidate);
+
+    int handle = add_unique_path(&scratch->seen, &scratch->arena, scratch->candidate, candidate_length);
+
+    if (handle != -1)
+    {
+      PathCostPair pair;
+      pair.handle = handle;
+      pair.cost = Cost;
+      insert(&scratch->pq, pair);
+    }
+  }
+}
+
+// Fills costs[i] with the cost of path[0..i], walking the path once.
+void prefix_costs(const Graph *graph, int path[], int length, int costs[])
+{
+  costs[0] = 0;
+  for (int i = 1; i < length; i++)
+  {
+    costs[i] = add_cost(costs[i - 1], graph->weights[find_edge(graph, path[i - 1], path[i])]);
+  }
+}
+
+// Packs one task per spur node of curr_path, in path order. A task is:
+//   root cost, root length, root nodes..., number of banned edges, next
+//   nodes of the found paths sharing the root...
+// The root path is curr_path[0..i] and the banned edges all leave its last
+// node, the spur node. Root costs are prefix costs of curr_path, which is
+// what the candidate cost needs (the shortest source -> spur node distance
+// can be lower than the root). Returns the buffer and stores its size in
+// ints in count, or returns NULL if the tasks do not fit in memory or in an
+// int count.
+int *build_spur_tasks(int curr_path[], int len, PathCostPair K_paths[], int k, PathArena *arena,
+                      const Graph *graph, int *count)
+{
+  // found path j shares the roots of curr_path up to shared[j] nodes long
+  // and bans the edge to its next node from each of them
+  int *shared = (int *)malloc((k > 0 ? k : 1) * sizeof(int));
+  size_t size = 0;
+  for (int j = 0; j < k; j++)
+  {
+    int *jth_path = arena_path(arena, K_paths[j].handle);
+    int jth_length = arena_path_length(arena, K_paths[j].handle);
+    int limit = len - 1 < jth_length - 1 ? len - 1 : jth_length - 1;
+    int length = 0;
+    while (length < limit && jth_path[length] == curr_path[length])
+      length++;
+    shared[j] = length;
+    size += length;
+  }
+  for (int i = 0; i < len - 1; i++)
+  {
+    size += 3 + (size_t)(i + 1);
+  }
+
+  int *buffer = size <= INT_MAX ? (int *)malloc(size * sizeof(int)) : NULL;
+  int *costs = (int *)malloc(len * sizeof(int));
+  if (buffer == NULL || costs == NULL)
+  {
+    free(buffer);
+    free(costs);
+    free(shared);
+    return NULL;
+  }
+  int pos = 0;
+
+  prefix_costs(graph, curr_path, len, costs);
+
+  for (int i = 0; i < len - 1; i++)
+  {
+    buffer[pos++] = costs[i];
+    buffer[pos++] = i + 1;
+    memcpy(buffer + pos, curr_path, (i + 1) * sizeof(int));
+    pos += i + 1;
+
+    int count_pos = pos++;
+    buffer[count_pos] = 0;
+    for (int j = 0; j < k; j++)
+    {
+      if (shared[j] >= i + 1)
+      {
+        buffer[pos++] = arena_path(arena, K_paths[j].handle)[i + 1];
+        buffer[count_pos]++;
+      }
+    }
+  }
+
+  free(costs);
+  free(shared);
+  *count = pos;
+  return buffer;
+}
+
+// Number of ints taken by the packed spur task starting at task.
+int spur_task_size(int task[])
+{
+  int root_length = task[1];
+  return 3 + root_length + task[2 + root_length];
+}
+
+// Runs the packed spur tasks as OpenMP tasks, each thread in its own scratch,
+// then merges the thread-local candidates into pq, dropping paths already
+// in seen. Without OpenMP the tasks simply run one after another.
+void run_spur_tasks(int tasks[], int task_count, const SinkTree *tree, const Graph *graph, SpurScratch scratch[], int num_threads,
+                    PathSet *seen, PathArena *arena, PriorityQueue *pq)
+{
+  // find where each variable-length task starts
+  int num_tasks = 0;
+  for (int pos = 0; pos < task_count; pos += spur_task_size(tasks + pos))
+  {
+    num_tasks++;
+  }
+
+  int *task_starts = (int *)malloc((num_tasks > 0 ? num_tasks : 1) * sizeof(int));
+  num_tasks = 0;
+  for (int pos = 0; pos < task_count; pos += spur_task_size(tasks + pos))
+  {
+    task_starts[num_tasks++] = pos;
+  }
+
+  #pragma omp parallel num_threads(num_threads)
+  {
+    #pragma omp single
+    {
+      for (int t = 0; t < num_tasks; t++)
+      {
+        #pragma omp task firstprivate(t)
+        {
+#ifdef _OPENMP
+          int thread = omp_get_thread_num();
+#else
+          int thread = 0;
+#endif
+          run_spur_task(tasks + task_starts[t], tree, graph, &scratch[thread]);
+        }
+      }
+    }
+  }
+
+  for (int t = 0; t < num_threads; t++)
+  {
+    PriorityQueue *thread_pq = &scratch[t].pq;
+    for (int c = 0; c < thread_pq->size; c++)
+    {
+      int thread_handle = thread_pq->pairs[c].handle;
+      int handle = add_unique_path(seen, arena, arena_path(&scratch[t].arena, thread_handle),
+                                   arena_path_length(&scratch[t].arena, thread_handle));
+      if (handle != -1)
+      {
+        PathCostPair pair;
+        pair.handle = handle;
+        pair.cost = thread_pq->pairs[c].cost;
+        insert(pq, pair);
+      }
+    }
+    reset_spur_scratch(&scratch[t]);
+  }
+
+  free(task_starts);
+}
+
+struct ResultCache;
+
+// Everything one query needs besides the graph, kept across queries so that
+// starting a new one does not allocate.
+typedef struct
+{
+  PathArena arena;  // every path of the current query
+  PathSet seen;
+  PriorityQueue pq;
+  SinkTreeCache trees;
+  const SinkTree *tree; // towards the sink of the current query, from trees
+  SpurScratch *scratch;
+  int num_threads;
+  int *path;
+  struct ResultCache *cache; // answers repeated queries, see cache.h; may be NULL
+  // sidetrack heaps of lazy walks (eppstein.h), allocated by the first one:
+  // heap_root[v] belongs to the current query if heap_stamp[v] is
+  // heap_generation
+  int *heap_root;
+  unsigned int *heap_stamp;
+  unsigned int heap_generation;
+  int *heap_stack;
+} YenWorkspace;
+
+void init_yen_workspace(YenWorkspace *ws, const Graph *graph)
+{
+  init_path_arena(&ws->arena);
+  init_path_set(&ws->seen);
+  initialize(&ws->pq);
+  init_sink_tree_cache(&ws->trees, graph);
+  ws->tree = NULL;
+#ifdef _OPENMP
+  ws->num_threads = omp_get_max_threads();
+#else
+  ws->num_threads = 1;
+#endif
+  ws->scratch = (SpurScratch *)malloc(ws->num_threads * sizeof(SpurScratch));
+  for (int t = 0; t < ws->num_threads; t++)
+  {
+    init_spur_scratch(&ws->scratch[t], graph);
+  }
+  ws->path = (int *)malloc(graph->num_nodes * sizeof(int));
+  ws->cache = NULL;
+  ws->heap_root = NULL;
+  ws->heap_stamp = NULL;
+  ws->heap_generation = 0;
+  ws->heap_stack = NULL;
+}
+
+void free_yen_workspace(YenWorkspace *ws)
+{
+  free_path_arena(&ws->arena);
+  free_path_set(&ws->seen);
+  free_queue(&ws->pq);
+  free_sink_tree_cache(&ws->trees);
+  for (int t = 0; t < ws->num_threads; t++)
+  {
+    free_spur_scratch(&ws->scratch[t]);
+  }
+  free(ws->scratch);
+  free(ws->path);
+  free(ws->heap_root);
+  free(ws->heap_stamp);
+  free(ws->heap_stack);
+}
+
+int get_work_done(YenWorkspace *ws)
+{
+  int work_done = 0;
+  for (int t = 0; t < ws->num_threads; t++)
+  {
+    work_done += ws->scratch[t].work_done;
+  }
+  return work_done;
+}
+
+// Starts a query: clears the arena, seen set and candidates of ws, builds
+// the sink tree and stores the shortest path in K_paths[0]. Returns the
+// number of paths found, 0 or 1.
+int first_shortest_path(const Graph *graph, int source, int sink, YenWorkspace *ws, PathCostPair K_paths[])
+{
+  reset_path_arena(&ws->arena);
+  reset_path_set(&ws->seen);
+  ws->pq.size = 0;
+  ws->pq.limit = 0;
+
+  // one backward search from the sink guides every spur search of the
+  // query, and its tree path from the source is the first path
+  ws->tree = sink_tree(&ws->trees, sink, graph);
+
+  int length;
+  int cost = dijkstra(source, sink, graph, NULL, ws->tree, &ws->scratch[0].search, ws->path, &length);
+  if (cost == INF)
+    return 0;
+
+  K_paths[0].handle = add_unique_path(&ws->seen, &ws->arena, ws->path, length);
+  K_paths[0].cost = cost;
+  return 1;
+}
+
+// Runs the Yen iterations of a query whose first found paths are in K_paths
+// and whose paths and candidates are in ws, until K paths are found or no
+// more exist; ws->tree must be the tree of the query's sink. Only the best
+// K - k candidates can become one of the K paths, so the others are dropped
+// unless keep_candidates is set, which a later call with a larger K needs.
+// Returns the new number of paths found.
+int extend_k_shortest_paths(const Graph *graph, int K, YenWorkspace *ws, PathCostPair K_paths[], int found,
+                            int keep_candidates)
+{
+  for (int k = found; k < K; k++)
+  {
+    // copied out of the arena, which may move while candidates are added
+    int len = arena_path_length(&ws->arena, K_paths[k - 1].handle);
+    int *curr_path = (int *)malloc(len * sizeof(int));
+    memcpy(curr_path, arena_path(&ws->arena, K_paths[k - 1].handle), len * sizeof(int));
+
+    set_queue_limit(&ws->pq, keep_candidates ? 0 : K - k);
+
+    int task_count;
+    int *tasks = build_spur_tasks(curr_path, len, K_paths, k, &ws->arena, graph, &task_count);
+    if (tasks == NULL)
+    {
+      fprintf(stderr, "Out of memory for the spur tasks of path %d, stopping the query.\n", k + 1);
+      free(curr_path);
+      break;
+    }
+    run_spur_tasks(tasks, task_count, ws->tree, graph, ws->scratch, ws->num_threads, &ws->seen, &ws->arena, &ws->pq);
+    free(tasks);
+    free(curr_path);
+
+    // fewer than K paths exist between source and sink
+    if (ws->pq.size == 0)
+      break;
+
+    K_paths[k] = extractMin(&ws->pq);
+    found++;
+  }
+
+  return found;
+}
+
+// Finds up to K loopless shortest source -> sink paths in increasing cost.
+// K_paths (room for K entries) receives their costs and handles into
+// ws->arena, valid until the next query. Returns the number of paths found,
+// less than K when no more paths exist.
+int yen_k_shortest_paths(const Graph *graph, int source, int sink, int K, YenWorkspace *ws, PathCostPair K_paths[])
+{
+  int found = first_shortest_path(graph, source, sink, ws, K_paths);
+  if (found == 0)
+    return 0;
+  return extend_k_shortest_paths(graph, K, ws, K_paths, found, 0);
+}
+
+#endif